@@ -2,11 +2,106 @@
 #include "clocks.h"
 #include "GPIO.h"
 #include "atomic.h"
+#include "delay.h"
+#include "events.h"
+#include "analog_cal.h"
 
 #define BAND_GAP_MV 1100
 
+// INTVCC0 is VDDANA / 1.48
+#define VDDANA_DIV_1V48_Q16 44281
+
 int32_t _ctrlB;
 
+// Continuous acquisition state, there is only the one ADC
+typedef struct
+{
+    void *            buf;
+    AnalogQueue_t     queue;
+    AnalogTrigger_t   trigger;
+    volatile bool     active;
+    volatile uint8_t  discard;
+    volatile uint32_t count;
+    volatile uint32_t dropped;
+    volatile uint32_t overruns;
+    uint32_t          startMicros;
+    uint32_t          stopMicros;
+} AnalogStream_t;
+
+AnalogStream_t _stream;
+
+// Timer pacing the ADC start input through the event system
+typedef struct
+{
+    TimerCounter *timer;
+    int8_t        channel;
+} AnalogPacer_t;
+
+AnalogPacer_t _pacer = {NULL, -1};
+
+// Window monitor state
+typedef struct
+{
+    volatile bool          active;
+    volatile bool          triggered;
+    volatile int16_t       value;
+    bool                   oneShot;
+    AnalogWindowCallback_t callback;
+} AnalogWindowState_t;
+
+AnalogWindowState_t _window = {false, false, 0, true, NULL};
+
+// Session state, the ADC is left enabled between reads and only reconfigured
+// when a different Analog object reads
+typedef struct
+{
+    bool          active;
+    const Analog *last;
+    int32_t       ref;
+    bool          discard;
+} AnalogSession_t;
+
+AnalogSession_t _session = {false, NULL, -1, false};
+
+// The scan being converted, and the last one to configure the ADC
+AnalogScan *volatile _scanActive = NULL;
+const AnalogScan *   _scanLast = NULL;
+
+// DAC waveform state, the timer paces it through an event channel or its
+// interrupt
+typedef struct
+{
+    const uint16_t *         buf[2];
+    uint32_t                 len;
+    volatile uint32_t        index;
+    volatile uint8_t         half;
+    bool                     loop;
+    AnalogWaveformCallback_t callback;
+    AnalogTrigger_t          trigger;
+    TimerCounter *           timer;
+    int8_t                   channel;
+    volatile bool            active;
+    volatile uint32_t        count;
+    volatile uint32_t        underruns;
+} AnalogWave_t;
+
+AnalogWave_t _wave;
+
+// Last VCC measurement, the reciprocal turns ratios into a multiply
+typedef struct
+{
+    bool     valid;
+    int16_t  mv;
+    uint32_t recipQ32;
+    uint32_t stamp;
+    uint32_t cacheMillis;
+} AnalogVCC_t;
+
+AnalogVCC_t _vcc = {false, 0, 0, 0, ANALOG_VCC_CACHE_MILLIS};
+
+// AREFA and AREFB in millivolts
+uint16_t _arefMv[2] = {0, 0};
+
 // ADC register synchronization macros
 #define ADC_SYNC_BUSY ( ADC->STATUS.bit.SYNCBUSY )
 #define ADC_WAIT_SYNC while( ADC_SYNC_BUSY )
@@ -71,11 +166,11 @@ int32_t _ctrlB;
 #define DAC_SYNC_BUSY ( DAC->STATUS.bit.SYNCBUSY )
 #define DAC_WAIT_SYNC while( DAC_SYNC_BUSY )
 
-int16_t singleShotConversion()
+int16_t singleShotConversion( bool discardFirst = true )
 {
     // The first conversion after the reference is changed must not be used.
     int16_t val;
-    for( uint8_t i = 0; i < 2; i++ ) {
+    for( uint8_t i = discardFirst ? 0 : 1; i < 2; i++ ) {
         // Start the next conversion
         ATOMIC_OPERATION( {
             if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
@@ -96,40 +191,125 @@ int16_t singleShotConversion()
     return val;
 }
 
-int16_t Analog::readSingle()
+// Powers up the ADC and loads the settings and input channels, the ADC is left
+// disabled
+bool Analog::configure()
 {
+    // Ensure the positive input channel is actually an analog channel
+    if( _posChannel == -1 ) return false;
+
     // Ensure the ADC is powered up
     BRING_UP_ADC
 
-    // Ensure the positive input channel is actually an analog channel
-    if( _posChannel == -1 ) return -1;
+    loadSettings();
+    return true;
+}
+
+// Writes the reference, resolution, prescaler, accumulation and sample length,
+// ctrlB holds any extra CTRLB bits (DIFFMODE, FREERUN)
+void Analog::applySettings( const AnalogSettings &settings, uint32_t ctrlB )
+{
+    _ctrlB = ctrlB;
+
+    // Configure the read parameters
+    ADC_SET_REF( settings._ref );
+    ADC_SET_RESOLUTION( settings._resolution );
+    ADC_SET_PRESCALER( settings._preScaler );
+    ADC_SET_SAMPLE_ACCUM( settings._accum );
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->CTRLB.reg = _ctrlB;
+    } )
+
+    // Sample length, from the source impedance when one was given
+    ADC->SAMPCTRL.reg =
+        ADC_SAMPCTRL_SAMPLEN( settings.getSampleLength() );
+}
+
+// The sample capacitor charges through the sampling switch and the source,
+// settling to within half an LSB takes
+//
+//  tSAMPLE >= ( RSAMPLE + RSOURCE ) * CSAMPLE * ( n + 2 ) * ln( 2 )
+//
+// where n is the resolution plus the extra bits of error the gain stage
+// amplifies. tSAMPLE is ( SAMPLEN + 1 ) half cycles of the ADC clock.
+uint8_t AnalogSettings::getSampleLength() const
+{
+    uint32_t fADC, prescale, gain, halfCycles;
+    int32_t  bits;
+    uint64_t tauFs, tSampleFs;
+
+    if( _sourceOhms == 0 ) return _sampleLen;
+    if( _sourceOhms > 10000000ul ) return ADC_SAMPCTRL_SAMPLEN_Msk;
+
+    // ADC clock is GCLK0 divided by the prescaler (DIV4 upwards)
+    prescale = ( _preScaler & ADC_CTRLB_PRESCALER_Msk ) >>
+               ADC_CTRLB_PRESCALER_Pos;
+    fADC = SystemCoreClock / ( 4ul << prescale );
+
+    // Accumulated results are 16 bits, but each conversion is 12
+    if( _resolution == ana_resolution_8bit )
+        bits = 8;
+    else if( _resolution == ana_resolution_10bit )
+        bits = 10;
+    else
+        bits = 12;
+
+    // Gains of 2x to 16x are 1 to 4 more bits to settle, DIV2 is one less
+    gain = ( _gain & ADC_INPUTCTRL_GAIN_Msk ) >> ADC_INPUTCTRL_GAIN_Pos;
+    if( gain == ADC_INPUTCTRL_GAIN_DIV2_Val )
+        bits -= 1;
+    else
+        bits += gain;
+
+    // Time constant in femtoseconds, then ( n + 2 ) * ln( 2 ) of them
+    tauFs = (uint64_t)( ANALOG_SAMPLE_RESISTANCE_OHMS + _sourceOhms ) *
+            ANALOG_SAMPLE_CAPACITANCE_FF;
+    tSampleFs = ( tauFs * ( bits + 2 ) * 693 ) / 1000;
+
+    // Round up to whole half cycles
+    halfCycles = ( uint32_t )(
+        ( tSampleFs * 2 * fADC + 999999999999999ull ) / 1000000000000000ull );
+    if( halfCycles > 0 ) halfCycles--;
+    if( halfCycles > ADC_SAMPCTRL_SAMPLEN_Msk )
+        halfCycles = ADC_SAMPCTRL_SAMPLEN_Msk;
+
+    return (uint8_t)halfCycles;
+}
+
+// Writes this object's settings and input channels to the ADC
+void Analog::loadSettings()
+{
+    uint32_t ctrlB = 0;
 
     // Configure input pins, if using dual-ended input configure for
     // differential mode
     pinMode( _posInputPin, gArduinoPins[_posInputPin].analog );
     if( _negInputPin != -1 ) {
         pinMode( _negInputPin, gArduinoPins[_negInputPin].analog );
-        _ctrlB |= ADC_CTRLB_DIFFMODE;
+        ctrlB |= ADC_CTRLB_DIFFMODE;
     }
 
-    // Configure the read parameters
-    ADC_SET_REF( _settings._ref );
-    ADC_SET_RESOLUTION( _settings._resolution );
-    ADC_SET_PRESCALER( _settings._preScaler );
-    ADC_SET_SAMPLE_ACCUM( _settings._accum );
-    ATOMIC_OPERATION( {
-        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
-        ADC->CTRLB.reg = _ctrlB;
-    } )
+    applySettings( _settings, ctrlB );
 
-    // Configure the gain, sample length (fixed), and the input channels
-    ADC->SAMPCTRL.reg = ADC_SAMPCTRL_MASK; // 64 ADC clock cycles
+    // Configure the gain and the input channels
     ATOMIC_OPERATION( {
         if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
         ADC->INPUTCTRL.reg = _settings._gain |
                              ADC_INPUTCTRL_MUXPOS( _posChannel ) |
                              ADC_INPUTCTRL_MUXNEG( _negChannel );
     } )
+}
+
+int16_t Analog::readSingle()
+{
+    // The ADC belongs to the stream (or scan, or window) until it is ended
+    if( _stream.active || _scanActive != NULL || _window.active ) return -1;
+
+    // Don't tear down a session that is in progress
+    if( _session.active ) return read();
+
+    if( !configure() ) return -1;
 
     // Enable the ADC
     ATOMIC_OPERATION( {
@@ -148,14 +328,90 @@ int16_t Analog::readSingle()
 int16_t Analog::readSingle( AnalogSettings settings )
 {
     _settings = settings;
+    if( _session.last == this ) _session.last = NULL;
     return readSingle();
 }
 
+// Keeps the ADC powered and enabled so reads only pay for the conversion. The
+// throw away conversion is only needed when the reference changes.
+bool Analog::beginSession()
+{
+    if( _stream.active || _scanActive != NULL || _window.active ) return false;
+    if( _session.active ) return true;
+    if( !configure() ) return false;
+
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->CTRLA.bit.ENABLE = 1;
+    } )
+
+    _session.active = true;
+    _session.last = this;
+    _session.ref = _settings._ref;
+    _session.discard = true;
+    return true;
+}
+
+int16_t Analog::read()
+{
+    if( !_session.active ) return readSingle();
+    if( _posChannel == -1 ) return -1;
+
+    // Reconfigure only when another object (or readVCC/readTemperature) used
+    // the ADC since the last read
+    if( _session.last != this ) {
+        loadSettings();
+        if( _settings._ref != _session.ref ) {
+            _session.ref = _settings._ref;
+            _session.discard = true;
+        }
+
+        if( !ADC->CTRLA.bit.ENABLE ) {
+            ATOMIC_OPERATION( {
+                if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+                ADC->CTRLA.bit.ENABLE = 1;
+            } )
+        }
+        _session.last = this;
+    }
+
+    int16_t val = singleShotConversion( _session.discard );
+    _session.discard = false;
+    return val;
+}
+
+void Analog::endSession()
+{
+    if( !_session.active ) return;
+
+    _session.active = false;
+    _session.last = NULL;
+
+    // Disable the peripheral to save power
+    TAKE_DOWN_ADC
+}
+
 void Analog::writeSingle( int16_t val, bool outputInternal )
+{
+    // The waveform owns the DAC while it plays
+    if( _wave.active ) return;
+    if( !configureDAC( outputInternal ) ) return;
+
+    ATOMIC_OPERATION( {
+        if( DAC_SYNC_BUSY ) DAC_WAIT_SYNC;
+        DAC->DATA.reg = val & 0x3FF;
+    } )
+}
+
+bool Analog::configureDAC( bool outputInternal )
 {
     // TODO: perhaps handle pins that aren't the DAC output pin
     if( gArduinoPins[_posInputPin].pin != 2 )
-        if( !outputInternal ) return;
+        if( !outputInternal ) return false;
+
+    // Already up, only the data needs writing
+    if( ( PM->APBCMASK.reg & PM_APBCMASK_DAC ) && DAC->CTRLA.bit.ENABLE )
+        return true;
 
     enableAPBCClk( PM_APBCMASK_DAC, 1 );
     initGenericClk( GCLK_CLKCTRL_GEN_GCLK0_Val, GCLK_CLKCTRL_ID_DAC_Val );
@@ -180,14 +436,18 @@ void Analog::writeSingle( int16_t val, bool outputInternal )
         } )
     }
 
-    ATOMIC_OPERATION( {
-        if( DAC_SYNC_BUSY ) DAC_WAIT_SYNC;
-        DAC->DATA.reg = val & 0x3FF;
-    } )
+    return true;
 }
 
 int16_t Analog::readVCC()
 {
+    // Measuring resets the ADC, leave it alone while something runs on it
+    bool adcBusy = _stream.active || _window.active || _scanActive != NULL;
+    if( _vcc.valid &&
+        ( adcBusy || millis() - _vcc.stamp < _vcc.cacheMillis ) )
+        return _vcc.mv;
+    if( adcBusy ) return -1;
+
     BRING_UP_ADC
 
     // Have to set the band-gap channel as an input into the ADC
@@ -203,7 +463,8 @@ int16_t Analog::readVCC()
         ADC->CTRLB.reg = _ctrlB;
     } )
 
-    // Configure the gain, sample length (fixed), and the input channels
+    // Configure the gain, sample length, and the input channels. The internal
+    // sources are high impedance so they keep the longest sample time.
     ADC->SAMPCTRL.reg = ADC_SAMPCTRL_MASK; // 64 ADC clock cycles
     ATOMIC_OPERATION( {
         if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
@@ -220,34 +481,116 @@ int16_t Analog::readVCC()
 
     int16_t val = singleShotConversion();
 
-    // Disable the peripheral to save power
-    TAKE_DOWN_ADC
+    // Disable the peripheral to save power. A session keeps it powered, but
+    // the reset means the next read has to reload everything.
+    if( _session.active ) {
+        _session.last = NULL;
+        _session.ref = -1;
+    }
+    else {
+        TAKE_DOWN_ADC
+    }
 
     // Take down the band gap input
     SYSCTRL->VREF.bit.BGOUTEN = 0;
 
-    // Convert band-gap to VCC
-    int16_t vccMv = ( ( BAND_GAP_MV * 4095 ) / val ) * 2;
-    return vccMv;
+    // Convert band-gap to VCC, these are the only divides until the cache
+    // runs out
+    _vcc.mv = ( ( BAND_GAP_MV * 4095 ) / val ) * 2;
+    _vcc.recipQ32 = 0xFFFFFFFFul / (uint32_t)_vcc.mv;
+    _vcc.stamp = millis();
+    _vcc.valid = true;
+
+    return _vcc.mv;
 }
 
-int16_t Analog::readTemperature()
+void Analog::setVCCCacheTime( uint32_t cacheMillis )
 {
-    // Read calibration values
-    uint32_t *tempLogLow = (uint32_t *)NVMCTRL_TEMP_LOG;
-    uint32_t *tempLogHigh = (uint32_t *)( NVMCTRL_TEMP_LOG + 4 );
-    int8_t    roomTempVal =
-        ( ( *tempLogLow ) & NVMCTRL_FUSES_ROOM_TEMP_VAL_INT_Msk ) >>
-        NVMCTRL_FUSES_ROOM_TEMP_VAL_INT_Pos;
-    int8_t hotRoomTempVal =
-        ( ( *tempLogLow ) & NVMCTRL_FUSES_HOT_TEMP_VAL_INT_Msk ) >>
-        NVMCTRL_FUSES_HOT_TEMP_VAL_INT_Pos;
-    int16_t roomADCVal =
-        ( ( *tempLogHigh ) & NVMCTRL_FUSES_ROOM_ADC_VAL_Msk ) >>
-        NVMCTRL_FUSES_ROOM_ADC_VAL_Pos;
-    int16_t hotADCVal = ( ( *tempLogHigh ) & NVMCTRL_FUSES_HOT_ADC_VAL_Msk ) >>
-                        NVMCTRL_FUSES_HOT_ADC_VAL_Pos;
+    _vcc.cacheMillis = cacheMillis;
+}
+
+void Analog::setExternalReference( AnalogReference_t ref,
+                                   uint16_t          millivolts )
+{
+    if( ref == ana_ref_external_a )
+        _arefMv[0] = millivolts;
+    else if( ref == ana_ref_external_b )
+        _arefMv[1] = millivolts;
+}
+
+// Full scale is 2^shift counts, gain and differential mode included. A DIV2
+// gain is left for the caller to double the reference.
+uint8_t Analog::resultShift()
+{
+    uint8_t shift, gain;
+
+    // Averaged results are adjusted back to 12 bits
+    if( _settings._accum != ana_accum_1 ||
+        _settings._resolution == ana_resolution_12bit )
+        shift = 12;
+    else if( _settings._resolution == ana_resolution_10bit )
+        shift = 10;
+    else
+        shift = 8;
 
+    gain = ( _settings._gain & ADC_INPUTCTRL_GAIN_Msk ) >>
+           ADC_INPUTCTRL_GAIN_Pos;
+    if( gain != ADC_INPUTCTRL_GAIN_DIV2_Val ) shift += gain;
+
+    // Signed results span -ref to +ref
+    if( _negInputPin != -1 ) shift--;
+
+    return shift;
+}
+
+int32_t Analog::toMillivolts( int16_t counts )
+{
+    int32_t refMv = 0;
+    uint8_t shift = resultShift();
+
+    switch( _settings._ref ) {
+        case ana_ref_internal_1v: refMv = 1000; break;
+        case ana_ref_internal_0_67_vddana:
+            refMv = ( readVCC() * VDDANA_DIV_1V48_Q16 ) >> 16;
+            break;
+        case ana_ref_internal_0_5_vddana: refMv = readVCC() >> 1; break;
+        case ana_ref_external_a: refMv = _arefMv[0]; break;
+        case ana_ref_external_b: refMv = _arefMv[1]; break;
+    }
+    if( refMv < 0 ) return 0;
+
+    if( ( _settings._gain & ADC_INPUTCTRL_GAIN_Msk ) == ana_gain_div2 )
+        refMv <<= 1;
+
+    return ( counts * refMv + ( 1l << ( shift - 1 ) ) ) >> shift;
+}
+
+int32_t Analog::toRatio( int16_t counts )
+{
+    uint32_t refQ16 = 0;
+    uint8_t  shift = resultShift();
+
+    // Reference as a fraction of VDDANA
+    switch( _settings._ref ) {
+        case ana_ref_internal_0_67_vddana: refQ16 = VDDANA_DIV_1V48_Q16; break;
+        case ana_ref_internal_0_5_vddana: refQ16 = 0x8000; break;
+        default:
+            refQ16 = 1000;
+            if( _settings._ref == ana_ref_external_a ) refQ16 = _arefMv[0];
+            if( _settings._ref == ana_ref_external_b ) refQ16 = _arefMv[1];
+            if( readVCC() < 0 ) return 0;
+            refQ16 = ( uint32_t )( ( (uint64_t)refQ16 * _vcc.recipQ32 ) >> 16 );
+            break;
+    }
+
+    if( ( _settings._gain & ADC_INPUTCTRL_GAIN_Msk ) == ana_gain_div2 )
+        refQ16 <<= 1;
+
+    return ( int32_t )( ( (int64_t)counts * refQ16 ) >> shift );
+}
+
+int16_t Analog::readTemperature()
+{
     BRING_UP_ADC
 
     // Have to set the temperature sensor channel as an input into the ADC
@@ -263,7 +606,8 @@ int16_t Analog::readTemperature()
         ADC->CTRLB.reg = _ctrlB;
     } )
 
-    // Configure the gain, sample length (fixed), and the input channels
+    // Configure the gain, sample length, and the input channels. The internal
+    // sources are high impedance so they keep the longest sample time.
     ADC->SAMPCTRL.reg = ADC_SAMPCTRL_MASK; // 64 ADC clock cycles
     ATOMIC_OPERATION( {
         if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
@@ -279,39 +623,565 @@ int16_t Analog::readTemperature()
 
     int16_t val = singleShotConversion();
 
-    // Disable the peripheral to save power
-    TAKE_DOWN_ADC
+    // Disable the peripheral to save power. A session keeps it powered, but
+    // the reset means the next read has to reload everything.
+    if( _session.active ) {
+        _session.last = NULL;
+        _session.ref = -1;
+    }
+    else {
+        TAKE_DOWN_ADC
+    }
 
     // Take down the temperature sensor
     SYSCTRL->VREF.bit.TSEN = 0;
 
     // Perform temperature conversion via interpolation using the calibration
-    // values. Calculation assumes that reference voltage is 1 volt, taken from
-    // the data sheet
-    int16_t temp =
-        roomTempVal +
-        ( ( ( val - roomADCVal ) * ( hotRoomTempVal - roomTempVal ) ) /
-          ( hotADCVal - roomADCVal ) );
+    // loaded at start up. Calculation assumes that reference voltage is 1
+    // volt, taken from the data sheet
+    int32_t tempQ16 = gAnalogCal.roomTempQ16 +
+                      ( val - gAnalogCal.roomADC ) * gAnalogCal.tempSlopeQ16;
+
+    return (int16_t)( ( tempQ16 + 0x8000 ) >> 16 );
+}
+
+// Routes the timer overflow to the ADC start input, the timer is left paused.
+// The asynchronous path adds no clock cycles of latency and needs no channel
+// clock, so with runInStandby the pacing carries on in standby.
+bool startADCPacer( TimerCounter *timer, uint32_t sampleRate,
+                    bool runInStandby = false )
+{
+    _pacer.channel = allocEventChannel();
+    if( _pacer.channel == -1 ) return false;
+
+    // A conversion starts at every wrap of the counter
+    _pacer.timer = timer;
+    timer->beginWrap( sampleRate, tc_mode_16_bit, false, runInStandby );
+    timer->pause();
+    timer->enableOverflowEvent( true );
+
+    initEventChannel( _pacer.channel, timer->getOverflowEventGenerator(),
+                      EVSYS_CHANNEL_PATH_ASYNCHRONOUS_Val,
+                      EVSYS_CHANNEL_EDGSEL_NO_EVT_OUTPUT_Val );
+    attachEventUser( _pacer.channel, EVSYS_ID_USER_ADC_START );
+    ADC->EVCTRL.reg |= ADC_EVCTRL_STARTEI;
+
+    return true;
+}
+
+void stopADCPacer()
+{
+    if( _pacer.timer == NULL ) return;
+
+    _pacer.timer->enableOverflowEvent( false );
+    _pacer.timer->end();
+    detachEventUser( EVSYS_ID_USER_ADC_START );
+    freeEventChannel( _pacer.channel );
+    ADC->EVCTRL.reg &= ~ADC_EVCTRL_STARTEI;
+
+    _pacer.timer = NULL;
+    _pacer.channel = -1;
+}
+
+bool Analog::startStream( void *buf, AnalogQueue_t queue,
+                          AnalogTrigger_t trigger, TimerCounter *timer,
+                          uint32_t sampleRate )
+{
+    if( buf == NULL || _stream.active || _session.active ) return false;
+    if( _scanActive != NULL || _window.active ) return false;
+    if( trigger == ana_trig_event && ( timer == NULL || sampleRate == 0 ) )
+        return false;
+    if( !configure() ) return false;
+
+    if( trigger == ana_trig_event && !startADCPacer( timer, sampleRate ) ) {
+        TAKE_DOWN_ADC
+        return false;
+    }
+
+    _stream.buf = buf;
+    _stream.queue = queue;
+    _stream.trigger = trigger;
+    _stream.count = 0;
+    _stream.dropped = 0;
+    _stream.overruns = 0;
+
+    // The first conversion after the reference is changed must not be used
+    _stream.discard = 1;
+
+    if( trigger == ana_trig_free_run ) {
+        _ctrlB |= ADC_CTRLB_FREERUN;
+        ATOMIC_OPERATION( {
+            if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+            ADC->CTRLB.reg = _ctrlB;
+        } )
+    }
+
+    // Results are collected by the ADC interrupt
+    ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY | ADC_INTFLAG_OVERRUN;
+    ADC->INTENSET.reg = ADC_INTENSET_RESRDY | ADC_INTENSET_OVERRUN;
+    NVIC_ClearPendingIRQ( ADC_IRQn );
+    NVIC_EnableIRQ( ADC_IRQn );
+
+    _stream.active = true;
+    _stream.startMicros = micros();
+
+    // Enable the ADC and kick off the first conversion, or let the timer
+    // do it
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->CTRLA.bit.ENABLE = 1;
+    } )
+    if( trigger == ana_trig_event ) {
+        _pacer.timer->resume();
+    }
+    else {
+        ATOMIC_OPERATION( {
+            if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+            ADC->SWTRIG.bit.START = 1;
+        } )
+    }
+
+    return true;
+}
+
+void Analog::endStream()
+{
+    if( !_stream.active ) return;
+
+    // Stop the pacing timer first so no start event is left in flight
+    stopADCPacer();
+
+    NVIC_DisableIRQ( ADC_IRQn );
+    ADC->INTENCLR.reg = ADC_INTENCLR_RESRDY | ADC_INTENCLR_OVERRUN;
+    _stream.stopMicros = micros();
+    _stream.active = false;
+
+    // Disable the peripheral to save power
+    TAKE_DOWN_ADC
+}
+
+bool Analog::isStreaming()
+{
+    return _stream.active;
+}
+
+uint32_t Analog::getStreamCount()
+{
+    return _stream.count;
+}
+
+uint32_t Analog::getStreamDropped()
+{
+    return _stream.dropped;
+}
+
+uint32_t Analog::getStreamOverruns()
+{
+    return _stream.overruns;
+}
+
+uint32_t Analog::getStreamSampleRate()
+{
+    uint32_t elapsed =
+        ( _stream.active ? micros() : _stream.stopMicros ) - _stream.startMicros;
+    if( elapsed == 0 ) return 0;
+
+    return ( uint32_t )( ( (uint64_t)_stream.count * 1000000ull ) / elapsed );
+}
+
+void Analog::onService()
+{
+    uint8_t flags = ADC->INTFLAG.reg;
+
+    if( _window.active ) {
+        if( flags & ADC_INTFLAG_WINMON ) {
+            ADC->INTFLAG.reg = ADC_INTFLAG_WINMON;
+
+            if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+            _window.value = ADC->RESULT.reg;
+            _window.triggered = true;
+
+            if( _window.oneShot ) ADC->INTENCLR.reg = ADC_INTENCLR_WINMON;
+            if( _window.callback != NULL ) _window.callback( _window.value );
+        }
+        return;
+    }
+
+    // A result was overwritten before it was read
+    if( flags & ADC_INTFLAG_OVERRUN ) {
+        ADC->INTFLAG.reg = ADC_INTFLAG_OVERRUN;
+        _stream.overruns++;
+    }
+
+    if( flags & ADC_INTFLAG_RESRDY ) {
+        int16_t val;
 
-    return temp;
+        // Reading the result clears RESRDY
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        val = ADC->RESULT.reg;
+
+        if( _stream.trigger == ana_trig_software ) {
+            if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+            ADC->SWTRIG.bit.START = 1;
+        }
+
+        if( _stream.discard )
+            _stream.discard--;
+        else if( _stream.queue( _stream.buf, val ) )
+            _stream.count++;
+        else
+            _stream.dropped++;
+    }
+}
+
+// Start events that come while the ADC is still busy are dropped, so a
+// sample has to fit in a period of the pacer
+uint32_t Analog::getWindowMaxRate()
+{
+    uint32_t cycles;
+
+    cycles =
+        ( _settings.getSampleLength() + 2 ) / 2 + ANALOG_WINDOW_CONV_CYCLES;
+    return ANALOG_WINDOW_CLK_FREQ / ( cycles << _settings._accum );
+}
+
+bool Analog::beginWindow( int16_t lower, int16_t upper, TimerCounter *timer,
+                          uint32_t sampleRate, AnalogWindow_t mode,
+                          AnalogWindowCallback_t cb, bool oneShot )
+{
+    if( _stream.active || _session.active || _scanActive != NULL ||
+        _window.active )
+        return false;
+    if( timer == NULL || sampleRate == 0 || sampleRate > getWindowMaxRate() )
+        return false;
+    if( !configure() ) return false;
+
+    // GCLK0 stops in standby, GCLK1 doesn't. Its 32kHz is slow enough without
+    // dividing it down further.
+    initGenericClk( GCLK_CLKCTRL_GEN_GCLK1_Val, GCLK_CLKCTRL_ID_ADC_Val );
+    ADC_SET_PRESCALER( ADC_CTRLB_PRESCALER_DIV4 );
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->CTRLB.reg = _ctrlB;
+    } )
+
+    if( !startADCPacer( timer, sampleRate, true ) ) {
+        TAKE_DOWN_ADC
+        return false;
+    }
+
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->WINLT.reg = lower;
+    } )
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->WINUT.reg = upper;
+    } )
+    ADC->WINCTRL.reg = ADC_WINCTRL_WINMODE( mode );
+
+    _window.callback = cb;
+    _window.oneShot = oneShot;
+    _window.triggered = false;
+
+    // Keep converting in standby
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->CTRLA.reg = ADC_CTRLA_RUNSTDBY | ADC_CTRLA_ENABLE;
+    } )
+
+    // The first conversion after the reference is changed must not be used,
+    // so it is started by hand and the monitor armed once it is thrown away
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->SWTRIG.bit.START = 1;
+    } )
+    while( !ADC->INTFLAG.bit.RESRDY )
+        ;
+    _pacer.timer->resume();
+
+    _window.active = true;
+    ADC->INTFLAG.reg = ADC_INTFLAG_WINMON | ADC_INTFLAG_RESRDY;
+    ADC->INTENSET.reg = ADC_INTENSET_WINMON;
+    NVIC_ClearPendingIRQ( ADC_IRQn );
+    NVIC_EnableIRQ( ADC_IRQn );
+
+    return true;
+}
+
+void Analog::endWindow()
+{
+    if( !_window.active ) return;
+
+    stopADCPacer();
+
+    NVIC_DisableIRQ( ADC_IRQn );
+    ADC->INTENCLR.reg = ADC_INTENCLR_WINMON;
+    ADC->WINCTRL.reg = 0;
+    _window.active = false;
+
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->CTRLA.bit.RUNSTDBY = 0;
+    } )
+
+    // Disable the peripheral to save power
+    TAKE_DOWN_ADC
+}
+
+void Analog::rearmWindow()
+{
+    if( !_window.active ) return;
+
+    _window.triggered = false;
+    ADC->INTFLAG.reg = ADC_INTFLAG_WINMON;
+    ADC->INTENSET.reg = ADC_INTENSET_WINMON;
+}
+
+bool Analog::isWindowTriggered()
+{
+    return _window.triggered;
+}
+
+int16_t Analog::getWindowValue()
+{
+    return _window.value;
+}
+
+// Steps through the waveform, returns false once a one shot waveform is done
+bool nextWaveSample( uint16_t *val )
+{
+    if( _wave.index == _wave.len ) {
+        if( _wave.buf[1] != NULL ) {
+            // Swap buffers and hand the finished one back for refilling
+            _wave.half ^= 1;
+            if( _wave.callback != NULL )
+                _wave.callback( (uint16_t *)_wave.buf[_wave.half ^ 1],
+                                _wave.len );
+        }
+        else if( !_wave.loop ) {
+            return false;
+        }
+        _wave.index = 0;
+    }
+
+    *val = _wave.buf[_wave.half][_wave.index++] & 0x3FF;
+    _wave.count++;
+    return true;
+}
+
+// Stops pacing but leaves the timer and event channel allocated, safe to call
+// from the interrupts
+void stopWave()
+{
+    _wave.timer->pause();
+    DAC->INTENCLR.reg = DAC_INTENCLR_EMPTY | DAC_INTENCLR_UNDERRUN;
+    _wave.active = false;
+}
+
+// Timer interrupt, writes the next sample straight to the DAC
+void waveTimerService()
+{
+    uint16_t val;
+
+    if( !_wave.active ) return;
+    if( !nextWaveSample( &val ) ) {
+        stopWave();
+        return;
+    }
+
+    if( DAC_SYNC_BUSY ) DAC_WAIT_SYNC;
+    DAC->DATA.reg = val;
+}
+
+bool Analog::beginWaveform( const uint16_t *samples, uint32_t count,
+                            TimerCounter *timer, uint32_t sampleRate,
+                            bool loop, AnalogTrigger_t trigger )
+{
+    return startWaveform( samples, NULL, count, loop, NULL, timer, sampleRate,
+                          trigger );
+}
+
+bool Analog::beginWaveform( uint16_t *buf0, uint16_t *buf1, uint32_t count,
+                            AnalogWaveformCallback_t cb, TimerCounter *timer,
+                            uint32_t sampleRate, AnalogTrigger_t trigger )
+{
+    if( buf1 == NULL ) return false;
+
+    return startWaveform( buf0, buf1, count, true, cb, timer, sampleRate,
+                          trigger );
+}
+
+bool Analog::startWaveform( const uint16_t *buf0, const uint16_t *buf1,
+                            uint32_t count, bool loop,
+                            AnalogWaveformCallback_t cb, TimerCounter *timer,
+                            uint32_t sampleRate, AnalogTrigger_t trigger )
+{
+    uint16_t val;
+
+    if( buf0 == NULL || count == 0 || timer == NULL || sampleRate == 0 )
+        return false;
+    if( trigger == ana_trig_free_run ) return false;
+
+    // Release whatever the last waveform left behind
+    endWaveform();
+    if( !configureDAC( false ) ) return false;
+
+    _wave.buf[0] = buf0;
+    _wave.buf[1] = buf1;
+    _wave.len = count;
+    _wave.index = 0;
+    _wave.half = 0;
+    _wave.loop = loop;
+    _wave.callback = cb;
+    _wave.trigger = trigger;
+    _wave.timer = timer;
+    _wave.count = 0;
+    _wave.underruns = 0;
+
+    // A sample goes out at every wrap of the counter
+    if( trigger == ana_trig_software ) {
+        _wave.channel = -1;
+        _wave.active = true;
+        timer->registerISR( waveTimerService );
+        timer->beginWrap( sampleRate, tc_mode_16_bit, true );
+        return true;
+    }
+
+    // The overflow event moves DATABUF into DATA, the DAC interrupt refills
+    // DATABUF behind it
+    _wave.channel = allocEventChannel();
+    if( _wave.channel == -1 ) {
+        _wave.timer = NULL;
+        return false;
+    }
+
+    timer->beginWrap( sampleRate, tc_mode_16_bit, false );
+    timer->pause();
+    timer->enableOverflowEvent( true );
+
+    initEventChannel( _wave.channel, timer->getOverflowEventGenerator(),
+                      EVSYS_CHANNEL_PATH_ASYNCHRONOUS_Val,
+                      EVSYS_CHANNEL_EDGSEL_NO_EVT_OUTPUT_Val );
+    attachEventUser( _wave.channel, EVSYS_ID_USER_DAC_START );
+    DAC->EVCTRL.reg = DAC_EVCTRL_STARTEI;
+
+    // First sample goes out now, the second waits for the first event
+    nextWaveSample( &val );
+    ATOMIC_OPERATION( {
+        if( DAC_SYNC_BUSY ) DAC_WAIT_SYNC;
+        DAC->DATA.reg = val;
+    } )
+    if( !nextWaveSample( &val ) ) return true;
+
+    ATOMIC_OPERATION( {
+        if( DAC_SYNC_BUSY ) DAC_WAIT_SYNC;
+        DAC->DATABUF.reg = val;
+    } )
+
+    DAC->INTFLAG.reg = DAC_INTFLAG_EMPTY | DAC_INTFLAG_UNDERRUN;
+    DAC->INTENSET.reg = DAC_INTENSET_EMPTY | DAC_INTENSET_UNDERRUN;
+    NVIC_ClearPendingIRQ( DAC_IRQn );
+    NVIC_EnableIRQ( DAC_IRQn );
+
+    _wave.active = true;
+    timer->resume();
+
+    return true;
+}
+
+void Analog::endWaveform()
+{
+    if( _wave.timer == NULL ) return;
+
+    NVIC_DisableIRQ( DAC_IRQn );
+    stopWave();
+
+    if( _wave.trigger == ana_trig_event ) {
+        _wave.timer->enableOverflowEvent( false );
+        detachEventUser( EVSYS_ID_USER_DAC_START );
+        freeEventChannel( _wave.channel );
+        DAC->EVCTRL.reg = 0;
+    }
+    else {
+        _wave.timer->deregisterISR();
+    }
+    _wave.timer->end();
+
+    _wave.timer = NULL;
+    _wave.channel = -1;
+}
+
+bool Analog::isPlaying()
+{
+    return _wave.active;
+}
+
+uint32_t Analog::getWaveformCount()
+{
+    return _wave.count;
+}
+
+uint32_t Analog::getWaveformUnderruns()
+{
+    return _wave.underruns;
+}
+
+void DAC_Handler()
+{
+    uint8_t  flags = DAC->INTFLAG.reg;
+    uint16_t val;
+
+    // A start event arrived before DATABUF was refilled
+    if( flags & DAC_INTFLAG_UNDERRUN ) {
+        DAC->INTFLAG.reg = DAC_INTFLAG_UNDERRUN;
+        _wave.underruns++;
+    }
+
+    if( flags & DAC_INTFLAG_EMPTY ) {
+        DAC->INTFLAG.reg = DAC_INTFLAG_EMPTY;
+
+        if( !nextWaveSample( &val ) ) {
+            stopWave();
+            return;
+        }
+
+        if( DAC_SYNC_BUSY ) DAC_WAIT_SYNC;
+        DAC->DATABUF.reg = val;
+    }
+}
+
+void ADC_Handler()
+{
+    if( _scanActive != NULL )
+        _scanActive->onService();
+    else
+        Analog::onService();
 }
 
 void Analog::setPosChannel( int32_t pin )
 {
+    _posChannel = analogChannel( pin );
+}
+
+// Returns the AIN channel for a pin, or -1 if the pin has no analog input
+int32_t Analog::analogChannel( int32_t pin )
+{
+    int32_t channel;
+
     // Ensure the pin supports analog, and that the pin is within valid
     // range of analog support
-    if( gArduinoPins[pin].analog == -1 || pin > PINS_COUNT )
-        _posChannel = -1;
-    else {
-        // Set the positive pin, pin mapping is taken directly from the data
-        // sheet. Allowable negative input pins for the SAMD20 are AIN0 -
-        // AIN19
-        _posChannel = gArduinoPins[pin].pin;
-        if( _posChannel < 4 )
-            _posChannel &= 0x1; // Low channels
-        else if( _posChannel > 7 && _posChannel < 12 )
-            _posChannel += 8; // High channels
-    }
+    if( gArduinoPins[pin].analog == -1 || pin > PINS_COUNT ) return -1;
+
+    // Set the positive pin, pin mapping is taken directly from the data
+    // sheet. Allowable positive input pins for the SAMD20 are AIN0 - AIN19
+    channel = gArduinoPins[pin].pin;
+    if( channel < 4 )
+        channel &= 0x1; // Low channels
+    else if( channel > 7 && channel < 12 )
+        channel += 8; // High channels
+
+    return channel;
 }
 
 void Analog::setNegChannel( int32_t pin )
@@ -331,3 +1201,167 @@ void Analog::setNegChannel( int32_t pin )
         if( _negChannel < 4 ) _negChannel &= 0x1;
     }
 }
+
+AnalogScan::AnalogScan( const int32_t *pins, uint8_t count,
+                        AnalogSettings settings )
+{
+    _settings = settings;
+    _count = ( count > ANALOG_SCAN_MAX_CHANNELS ) ? ANALOG_SCAN_MAX_CHANNELS
+                                                  : count;
+    _valid = ( pins != NULL && _count > 0 );
+    _results = NULL;
+    _index = 0;
+    _discard = 0;
+    _busy = false;
+    _callback = NULL;
+
+    for( uint8_t i = 0; i < _count && _valid; i++ ) {
+        _pins[i] = pins[i];
+        _channels[i] = Analog::analogChannel( pins[i] );
+        if( _channels[i] == -1 ) _valid = false;
+    }
+
+    // Channels that follow each other can be stepped through by the ADC
+    // itself using INPUTSCAN
+    _contiguous = _valid;
+    for( uint8_t i = 1; i < _count && _contiguous; i++ ) {
+        if( _channels[i] != _channels[0] + i ) _contiguous = false;
+    }
+}
+
+bool AnalogScan::start( int16_t *results, AnalogScanCallback_t cb )
+{
+    uint32_t ctrlB = 0;
+
+    if( !_valid || results == NULL || _busy ) return false;
+    if( _stream.active || _session.active || _scanActive != NULL ||
+        _window.active )
+        return false;
+
+    // Skip the set up (and the throw away conversion) when this scan was the
+    // last to use the ADC and nothing has powered it down since
+    if( _scanLast != this || !( PM->APBCMASK.reg & PM_APBCMASK_ADC ) ) {
+        BRING_UP_ADC
+
+        for( uint8_t i = 0; i < _count; i++ )
+            pinMode( _pins[i], gArduinoPins[_pins[i]].analog );
+
+        // Contiguous channels convert back to back, the ADC moves the mux
+        if( _contiguous ) ctrlB |= ADC_CTRLB_FREERUN;
+        Analog::applySettings( _settings, ctrlB );
+
+        // The first conversion after the reference is changed must not be
+        // used
+        _discard = 1;
+        _scanLast = this;
+    }
+    else {
+        _discard = 0;
+    }
+
+    _results = results;
+    _callback = cb;
+    _index = 0;
+    _busy = true;
+    _scanActive = this;
+
+    // Writing INPUTCTRL also resets INPUTOFFSET back to the first channel
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->INPUTCTRL.reg =
+            _settings._gain | ADC_INPUTCTRL_MUXPOS( _channels[0] ) |
+            ADC_INPUTCTRL_MUXNEG( ADC_INPUTCTRL_MUXNEG_GND_Val ) |
+            ( _contiguous ? ADC_INPUTCTRL_INPUTSCAN( _count - 1 ) : 0 );
+    } )
+
+    ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY | ADC_INTFLAG_OVERRUN;
+    ADC->INTENSET.reg = ADC_INTENSET_RESRDY;
+    NVIC_ClearPendingIRQ( ADC_IRQn );
+    NVIC_EnableIRQ( ADC_IRQn );
+
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->CTRLA.bit.ENABLE = 1;
+    } )
+    ATOMIC_OPERATION( {
+        if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+        ADC->SWTRIG.bit.START = 1;
+    } )
+
+    return true;
+}
+
+bool AnalogScan::read( int16_t *results )
+{
+    if( !start( results ) ) return false;
+
+    while( _busy ) {
+        // If the ADC interrupt can't fire then service it from here
+        if( __get_PRIMASK() || !NVIC_GetEnableIRQ( ADC_IRQn ) ) onService();
+    }
+
+    return true;
+}
+
+bool AnalogScan::isBusy()
+{
+    return _busy;
+}
+
+bool AnalogScan::isValid()
+{
+    return _valid;
+}
+
+bool AnalogScan::isContiguous()
+{
+    return _contiguous;
+}
+
+void AnalogScan::end()
+{
+    if( _busy || _scanLast != this ) return;
+
+    _scanLast = NULL;
+
+    // Disable the peripheral to save power
+    TAKE_DOWN_ADC
+}
+
+void AnalogScan::onService()
+{
+    uint8_t k;
+
+    if( !ADC->INTFLAG.bit.RESRDY ) return;
+
+    // Reading the result clears RESRDY
+    if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+    int16_t val = ADC->RESULT.reg;
+
+    // Free running conversion k is on channel k % count, so after a throw
+    // away conversion the first channel comes around again last
+    k = _index++;
+    if( k >= _discard ) _results[k % _count] = val;
+
+    if( _index < _count + _discard ) {
+        // Non-contiguous channels are chained from here, one at a time
+        if( !_contiguous ) {
+            if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+            ADC->INPUTCTRL.bit.MUXPOS = _channels[_index % _count];
+            if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+            ADC->SWTRIG.bit.START = 1;
+        }
+        return;
+    }
+
+    // Every channel is in, stop the free running conversion that has started
+    // and leave the ADC powered for the next scan
+    ADC->INTENCLR.reg = ADC_INTENCLR_RESRDY;
+    if( ADC_SYNC_BUSY ) ADC_WAIT_SYNC;
+    ADC->CTRLA.bit.ENABLE = 0;
+    ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY | ADC_INTFLAG_OVERRUN;
+
+    _scanActive = NULL;
+    _busy = false;
+    if( _callback != NULL ) _callback( _results, _count );
+}
@@ -3,7 +3,10 @@
 
 #include "sam.h"
 #include <stdbool.h>
+#include <string.h>
 #include "variant.h"
+#include "RingBuffer.h"
+#include "TimerCounter.h"
 
 typedef enum
 {
@@ -58,6 +61,51 @@ typedef enum
     ana_gain_16x = ADC_INPUTCTRL_GAIN_16X
 } AnalogGain_t;
 
+typedef enum
+{
+    ana_trig_free_run, // Conversions run back to back
+    ana_trig_software, // Each conversion is started from the ADC interrupt
+    ana_trig_event     // Each conversion is started by a timer overflow event
+} AnalogTrigger_t;
+
+// Queues a streamed sample, returns 0 if there was no room
+typedef uint32_t ( *AnalogQueue_t )( void *buf, int16_t val );
+
+typedef enum
+{
+    ana_window_above = ADC_WINCTRL_WINMODE_MODE1_Val,  // Above lower
+    ana_window_below = ADC_WINCTRL_WINMODE_MODE2_Val,  // Below upper
+    ana_window_inside = ADC_WINCTRL_WINMODE_MODE3_Val, // Between the two
+    ana_window_outside = ADC_WINCTRL_WINMODE_MODE4_Val // Left the band
+} AnalogWindow_t;
+
+// Called from the ADC interrupt with the result that matched the window
+typedef void ( *AnalogWindowCallback_t )( int16_t value );
+
+// Called from the ADC interrupt once every channel of a scan is converted
+typedef void ( *AnalogScanCallback_t )( int16_t *results, uint8_t count );
+
+#define ANALOG_SCAN_MAX_CHANNELS 20
+
+// Called from interrupt context with a waveform buffer that has finished
+// playing, refill it before the other buffer runs out
+typedef void ( *AnalogWaveformCallback_t )( uint16_t *buf, uint32_t count );
+
+// Sample and hold model from the electrical characteristics, used to work out
+// the sampling time needed for a given source impedance
+#define ANALOG_SAMPLE_RESISTANCE_OHMS 3500
+#define ANALOG_SAMPLE_CAPACITANCE_FF 3500
+
+// How long readVCC() returns the last measurement before measuring again
+#define ANALOG_VCC_CACHE_MILLIS 1000
+
+// The window monitor's ADC clock, GCLK1 on the smallest prescaler. A 12 bit
+// conversion takes under ANALOG_WINDOW_CONV_CYCLES of its cycles after the
+// ( SAMPLEN + 1 ) half cycles of sampling, averaging repeats both for every
+// sample accumulated.
+#define ANALOG_WINDOW_CLK_FREQ ( TC_STANDBY_CLK_FREQ / 4 )
+#define ANALOG_WINDOW_CONV_CYCLES 8
+
 class AnalogSettings
 {
   public:
@@ -68,6 +116,8 @@ class AnalogSettings
         _accum = ana_accum_1;
         _ref = ana_ref_internal_1v;
         _gain = ana_gain_1x;
+        _sampleLen = ADC_SAMPCTRL_SAMPLEN_Msk;
+        _sourceOhms = 0;
     }
 
     AnalogSettings( AnalogReference_t refr, AnalogResolution_t res,
@@ -79,6 +129,8 @@ class AnalogSettings
         _accum = accum;
         _ref = refr;
         _gain = gain;
+        _sampleLen = ADC_SAMPCTRL_SAMPLEN_Msk;
+        _sourceOhms = 0;
     }
 
     AnalogSettings &operator=( const AnalogSettings &arg )
@@ -88,17 +140,37 @@ class AnalogSettings
         this->_ref = arg._ref;
         this->_preScaler = arg._preScaler;
         this->_accum = arg._accum;
+        this->_sampleLen = arg._sampleLen;
+        this->_sourceOhms = arg._sourceOhms;
         return *this;
     }
 
+    // Sampling time is (SAMPLEN + 1) half ADC clock cycles, the default is
+    // the longest (63). Either set SAMPLEN directly or give the impedance of
+    // the source and the shortest time that lets the sample capacitor settle
+    // to within half an LSB (after gain) is used.
+    void setSampleLength( uint8_t sampleLen )
+    {
+        _sampleLen = sampleLen & ADC_SAMPCTRL_SAMPLEN_Msk;
+        _sourceOhms = 0;
+    }
+    void setSourceImpedance( uint32_t ohms )
+    {
+        _sourceOhms = ohms;
+    }
+    uint8_t getSampleLength() const;
+
   private:
     AnalogResolution_t _resolution;
     AnalogReference_t  _ref;
     AnalogPrescaler_t  _preScaler;
     AnalogAccum_t      _accum;
     AnalogGain_t       _gain;
+    uint8_t            _sampleLen;
+    uint32_t           _sourceOhms;
 
     friend class Analog;
+    friend class AnalogScan;
 };
 
 class Analog
@@ -130,12 +202,158 @@ class Analog
     static int16_t readVCC();
     static int16_t readTemperature();
 
+    // readVCC() only measures the band gap again once cacheMillis have passed
+    // (0 measures every time). While the ADC is streaming, scanning or
+    // watching a window the cached value is returned regardless.
+    static void setVCCCacheTime( uint32_t cacheMillis );
+
+    // Voltage on AREFA or AREFB, needed to convert results using them
+    static void setExternalReference( AnalogReference_t ref,
+                                      uint16_t          millivolts );
+
+    // Converts a result read with this object's settings without dividing.
+    // References that follow VDDANA use readVCC(). toRatio() gives the input
+    // as a Q16.16 fraction of VDDANA.
+    int32_t toMillivolts( int16_t counts );
+    int32_t toRatio( int16_t counts );
+
+    // Keeps the ADC enabled between reads for bursts of conversions. read()
+    // only reconfigures the ADC when another object read last, and only throws
+    // away a conversion when the reference changed. Without a session read()
+    // is the same as readSingle().
+    bool        beginSession();
+    int16_t     read();
+    static void endSession();
+
+    // Continuous acquisition. The ADC is configured once and left running,
+    // every result is queued into buf from the ADC interrupt. Only one stream
+    // can run at a time and readSingle() returns -1 while it does.
+    template <int N>
+    bool beginStream( RingBufferN<int16_t, N> *buf,
+                      AnalogTrigger_t          trigger = ana_trig_free_run )
+    {
+        return startStream( buf, queueSample<N>, trigger, NULL, 0 );
+    }
+
+    // Timer paced acquisition, the timer's overflow event starts each
+    // conversion through the event system so samples carry no software
+    // jitter. The timer is started at sampleRate and stopped by endStream(),
+    // getOverflowFrequency() on it gives the rate actually achieved.
+    template <int N>
+    bool beginStream( RingBufferN<int16_t, N> *buf, TimerCounter *timer,
+                      uint32_t sampleRate )
+    {
+        return startStream( buf, queueSample<N>, ana_trig_event, timer,
+                            sampleRate );
+    }
+    static void     endStream();
+    static bool     isStreaming();
+    static uint32_t getStreamCount();      // Samples queued
+    static uint32_t getStreamDropped();    // Samples lost to a full buffer
+    static uint32_t getStreamOverruns();   // Samples lost to ADC overruns
+    static uint32_t getStreamSampleRate(); // Measured samples per second
+
+    // Window monitor. Conversions are paced by timer without the CPU and the
+    // ADC interrupt only fires when a result matches mode (ana_window_outside
+    // for leaving the lower/upper band). With oneShot the monitor goes quiet
+    // after the first match until rearmWindow(). The timer and the ADC run
+    // from GCLK1 while the window is armed so it keeps watching in standby,
+    // the ADC clock is then ANALOG_WINDOW_CLK_FREQ whatever the prescaler.
+    // sampleRate can't be more than getWindowMaxRate(), which the sample
+    // length and averaging bring down.
+    bool beginWindow( int16_t lower, int16_t upper, TimerCounter *timer,
+                      uint32_t               sampleRate,
+                      AnalogWindow_t         mode = ana_window_outside,
+                      AnalogWindowCallback_t cb = NULL, bool oneShot = true );
+    uint32_t       getWindowMaxRate();
+    static void    endWindow();
+    static void    rearmWindow();
+    static bool    isWindowTriggered();
+    static int16_t getWindowValue();
+
+    // DAC waveform output. Samples (10 bit) are played at sampleRate off the
+    // timer, either by its overflow event loading the DAC data buffer
+    // (ana_trig_event, no jitter) or by its interrupt writing the DAC
+    // (ana_trig_software). A single buffer plays once or loops, two buffers
+    // alternate with cb called to refill the one that finished. The DAC holds
+    // the last sample once a one shot waveform is done.
+    bool beginWaveform( const uint16_t *samples, uint32_t count,
+                        TimerCounter *timer, uint32_t sampleRate,
+                        bool loop = false,
+                        AnalogTrigger_t trigger = ana_trig_event );
+    bool beginWaveform( uint16_t *buf0, uint16_t *buf1, uint32_t count,
+                        AnalogWaveformCallback_t cb, TimerCounter *timer,
+                        uint32_t        sampleRate,
+                        AnalogTrigger_t trigger = ana_trig_event );
+    static void     endWaveform();
+    static bool     isPlaying();
+    static uint32_t getWaveformCount();     // Samples played
+    static uint32_t getWaveformUnderruns(); // Start events with no sample
+
+    static void onService();
+
   private:
     AnalogSettings _settings;
     int32_t        _posInputPin, _negInputPin, _posChannel, _negChannel;
 
     void setPosChannel( int32_t pin );
     void setNegChannel( int32_t pin );
+    bool    configure();
+    bool    configureDAC( bool outputInternal );
+    void    loadSettings();
+    uint8_t resultShift();
+
+    static int32_t analogChannel( int32_t pin );
+    static void    applySettings( const AnalogSettings &settings,
+                                  uint32_t              ctrlB );
+    bool startStream( void *buf, AnalogQueue_t queue,
+                      AnalogTrigger_t trigger, TimerCounter *timer,
+                      uint32_t sampleRate );
+    bool startWaveform( const uint16_t *buf0, const uint16_t *buf1,
+                        uint32_t count, bool loop,
+                        AnalogWaveformCallback_t cb, TimerCounter *timer,
+                        uint32_t sampleRate, AnalogTrigger_t trigger );
+
+    template <int N> static uint32_t queueSample( void *buf, int16_t val )
+    {
+        return ( (RingBufferN<int16_t, N> *)buf )->Queue( val );
+    }
+
+    friend class AnalogScan;
+};
+
+// Converts a list of single ended channels in one go, results are written in
+// the order of the pin list. Channels that follow each other (AIN4, AIN5,
+// AIN6..) are stepped through by the ADC using INPUTSCAN, any other list is
+// chained from the ADC interrupt by rewriting MUXPOS. The ADC stays powered
+// between scans until end() is called.
+class AnalogScan
+{
+  public:
+    AnalogScan( const int32_t *pins, uint8_t count,
+                AnalogSettings settings = AnalogSettings() );
+
+    bool start( int16_t *results, AnalogScanCallback_t cb = NULL );
+    bool read( int16_t *results );
+    bool isBusy();
+    bool isValid();
+    bool isContiguous();
+    void end();
+
+    void onService();
+
+  private:
+    AnalogSettings       _settings;
+    int32_t              _pins[ANALOG_SCAN_MAX_CHANNELS];
+    int32_t              _channels[ANALOG_SCAN_MAX_CHANNELS];
+    uint8_t              _count;
+    bool                 _valid;
+    bool                 _contiguous;
+    int16_t *            _results;
+    volatile uint8_t     _index;
+    uint8_t              _discard;
+    volatile bool        _busy;
+    AnalogScanCallback_t _callback;
 };
 
 #endif /* ANALOG_H_ */
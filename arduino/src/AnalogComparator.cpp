@@ -0,0 +1,267 @@
+/*
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "AnalogComparator.h"
+#include "clocks.h"
+#include "GPIO.h"
+#include "atomic.h"
+
+// AC register synchronization macros
+#define AC_SYNC_BUSY ( AC->STATUSB.bit.SYNCBUSY )
+#define AC_WAIT_SYNC while( AC_SYNC_BUSY )
+
+// Comparator owners, the interrupt is shared
+AnalogComparator *_comparators[AC_COMPARATOR_COUNT] = {NULL, NULL};
+
+AnalogComparator::AnalogComparator( int32_t posPin, int32_t negPin )
+{
+    int8_t negInput = acInput( negPin );
+
+    _posPin = posPin;
+    _negPin = negPin;
+    _posInput = acInput( posPin );
+    _negInput = AC_COMPCTRL_MUXNEG( negInput );
+    _scaler = 0;
+    _num = -1;
+    _mode = ac_continuous;
+    _compCtrl = 0;
+    _callback = NULL;
+
+    // Both inputs have to be AC pins
+    if( negInput == -1 ) _posInput = -1;
+}
+
+AnalogComparator::AnalogComparator( int32_t posPin, ACReference_t ref,
+                                    uint8_t scaler )
+{
+    _posPin = posPin;
+    _negPin = -1;
+    _posInput = acInput( posPin );
+    _negInput = ref;
+    _scaler = scaler & AC_SCALER_VALUE_Msk;
+    _num = -1;
+    _mode = ac_continuous;
+    _compCtrl = 0;
+    _callback = NULL;
+}
+
+// Maps a pin to its AC input, PA04..PA07 are AIN0..3
+int8_t AnalogComparator::acInput( int32_t pin )
+{
+    if( pin < 0 || pin >= PINS_COUNT ) return -1;
+    if( gArduinoPins[pin].port != PORTA ) return -1;
+    if( gArduinoPins[pin].pin < 4 || gArduinoPins[pin].pin > 7 ) return -1;
+
+    return gArduinoPins[pin].pin - 4;
+}
+
+bool AnalogComparator::begin( ACMode_t mode, bool hysteresis,
+                              bool runInStandby )
+{
+    uint8_t n;
+
+    if( _posInput == -1 || _num != -1 ) return false;
+
+    // Take whichever comparator is free
+    for( n = 0; n < AC_COMPARATOR_COUNT; n++ )
+        if( _comparators[n] == NULL ) break;
+    if( n == AC_COMPARATOR_COUNT ) return false;
+
+    _num = n;
+    _mode = mode;
+    _comparators[n] = this;
+
+    // Both comparators share the clocks, so once one runs in standby they both
+    // stay on GCLK1
+    enableAPBCClk( PM_APBCMASK_AC, 1 );
+    if( runInStandby || !( AC->CTRLA.reg & AC_CTRLA_ENABLE ) ) {
+        uint32_t gen = runInStandby ? GCLK_CLKCTRL_GEN_GCLK1_Val
+                                    : GCLK_CLKCTRL_GEN_GCLK0_Val;
+        initGenericClk( gen, GCLK_CLKCTRL_ID_AC_DIG_Val );
+        initGenericClk( gen, GCLK_CLKCTRL_ID_AC_ANA_Val );
+    }
+
+    // SWRST, unless the other comparator is running
+    if( !( AC->CTRLA.reg & AC_CTRLA_ENABLE ) ) {
+        ATOMIC_OPERATION( {
+            if( AC_SYNC_BUSY ) AC_WAIT_SYNC;
+            AC->CTRLA.reg = AC_CTRLA_SWRST;
+        } )
+        while( AC->CTRLA.reg & AC_CTRLA_SWRST )
+            ;
+    }
+
+    pinMode( _posPin, gArduinoPins[_posPin].analog );
+    if( _negPin != -1 ) pinMode( _negPin, gArduinoPins[_negPin].analog );
+    AC->SCALER[_num].reg = AC_SCALER_VALUE( _scaler );
+
+    _compCtrl = AC_COMPCTRL_MUXPOS( _posInput ) | _negInput |
+                AC_COMPCTRL_INTSEL_TOGGLE | AC_COMPCTRL_OUT_OFF |
+                AC_COMPCTRL_FLEN_OFF;
+    _compCtrl |= runInStandby ? AC_COMPCTRL_SPEED_LOWPOWER
+                              : AC_COMPCTRL_SPEED_HIGHSPEED;
+    if( hysteresis ) _compCtrl |= AC_COMPCTRL_HYST;
+    if( mode == ac_single_shot ) _compCtrl |= AC_COMPCTRL_SINGLE;
+
+    ATOMIC_OPERATION( {
+        if( AC_SYNC_BUSY ) AC_WAIT_SYNC;
+        AC->CTRLA.reg |=
+            AC_CTRLA_ENABLE | ( runInStandby ? AC_CTRLA_RUNSTDBY_Msk : 0 );
+    } )
+    writeCompCtrl( _compCtrl );
+
+    NVIC_EnableIRQ( AC_IRQn );
+
+    return true;
+}
+
+// COMPCTRL can only be changed while the comparator is disabled
+void AnalogComparator::writeCompCtrl( uint32_t compCtrl )
+{
+    ATOMIC_OPERATION( {
+        if( AC_SYNC_BUSY ) AC_WAIT_SYNC;
+        AC->COMPCTRL[_num].reg = compCtrl & ~AC_COMPCTRL_ENABLE;
+    } )
+    ATOMIC_OPERATION( {
+        if( AC_SYNC_BUSY ) AC_WAIT_SYNC;
+        AC->COMPCTRL[_num].reg = compCtrl | AC_COMPCTRL_ENABLE;
+    } )
+
+    // Wait for the start up time, single shot comparators only power up
+    // when started
+    if( _mode == ac_continuous )
+        while( !isReady() )
+            ;
+
+    AC->INTFLAG.reg = AC_INTFLAG_COMP0 << _num;
+}
+
+void AnalogComparator::end()
+{
+    if( _num == -1 ) return;
+
+    detachInterrupt();
+    enableEvent( false );
+    ATOMIC_OPERATION( {
+        if( AC_SYNC_BUSY ) AC_WAIT_SYNC;
+        AC->COMPCTRL[_num].reg = 0;
+    } )
+
+    _comparators[_num] = NULL;
+    _num = -1;
+
+    // Last one out takes the module down
+    if( _comparators[0] == NULL && _comparators[1] == NULL ) {
+        NVIC_DisableIRQ( AC_IRQn );
+        ATOMIC_OPERATION( {
+            if( AC_SYNC_BUSY ) AC_WAIT_SYNC;
+            AC->CTRLA.reg = 0;
+        } )
+        disableGenericClk( GCLK_CLKCTRL_ID_AC_DIG_Val );
+        disableGenericClk( GCLK_CLKCTRL_ID_AC_ANA_Val );
+        enableAPBCClk( PM_APBCMASK_AC, 0 );
+    }
+}
+
+bool AnalogComparator::read()
+{
+    if( _num == -1 ) return false;
+
+    if( _mode == ac_single_shot ) {
+        start();
+        while( !isReady() )
+            ;
+    }
+
+    return AC->STATUSA.reg & ( AC_STATUSA_STATE0 << _num );
+}
+
+void AnalogComparator::start()
+{
+    if( _num == -1 ) return;
+
+    ATOMIC_OPERATION( {
+        if( AC_SYNC_BUSY ) AC_WAIT_SYNC;
+        AC->CTRLB.reg = AC_CTRLB_START0 << _num;
+    } )
+}
+
+bool AnalogComparator::isReady()
+{
+    if( _num == -1 ) return false;
+
+    return AC->STATUSB.reg & ( AC_STATUSB_READY0 << _num );
+}
+
+void AnalogComparator::setScaler( uint8_t scaler )
+{
+    _scaler = scaler & AC_SCALER_VALUE_Msk;
+    if( _num != -1 ) AC->SCALER[_num].reg = AC_SCALER_VALUE( _scaler );
+}
+
+void AnalogComparator::attachInterrupt( ACCallback_t cb, ACInterrupt_t type )
+{
+    if( _num == -1 ) return;
+
+    _callback = cb;
+    if( ( _compCtrl & AC_COMPCTRL_INTSEL_Msk ) != (uint32_t)type ) {
+        _compCtrl = ( _compCtrl & ~AC_COMPCTRL_INTSEL_Msk ) | type;
+        writeCompCtrl( _compCtrl );
+    }
+
+    AC->INTFLAG.reg = AC_INTFLAG_COMP0 << _num;
+    AC->INTENSET.reg = AC_INTENSET_COMP0 << _num;
+}
+
+void AnalogComparator::detachInterrupt()
+{
+    if( _num == -1 ) return;
+
+    AC->INTENCLR.reg = AC_INTENCLR_COMP0 << _num;
+    _callback = NULL;
+}
+
+void AnalogComparator::enableEvent( bool enable )
+{
+    if( _num == -1 ) return;
+
+    if( enable )
+        AC->EVCTRL.reg |= AC_EVCTRL_COMPEO0 << _num;
+    else
+        AC->EVCTRL.reg &= ~( AC_EVCTRL_COMPEO0 << _num );
+}
+
+uint32_t AnalogComparator::getEventGenerator()
+{
+    return _num == 1 ? EVSYS_ID_GEN_AC_COMP_1 : EVSYS_ID_GEN_AC_COMP_0;
+}
+
+void AnalogComparator::onService()
+{
+    AC->INTFLAG.reg = AC_INTFLAG_COMP0 << _num;
+    if( _callback != NULL )
+        _callback( AC->STATUSA.reg & ( AC_STATUSA_STATE0 << _num ) );
+}
+
+void AC_Handler()
+{
+    uint8_t flags = AC->INTFLAG.reg & AC->INTENSET.reg;
+
+    for( uint8_t n = 0; n < AC_COMPARATOR_COUNT; n++ ) {
+        if( ( flags & ( AC_INTFLAG_COMP0 << n ) ) && _comparators[n] != NULL )
+            _comparators[n]->onService();
+    }
+}
@@ -0,0 +1,100 @@
+/*
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ANALOGCOMPARATOR_H_
+#define ANALOGCOMPARATOR_H_
+
+#include "sam.h"
+#include <stdbool.h>
+#include "variant.h"
+
+#define AC_COMPARATOR_COUNT 2
+
+// Negative input when it isn't a pin. VSCALE is VDDANA * ( scaler + 1 ) / 64.
+typedef enum
+{
+    ac_ref_gnd = AC_COMPCTRL_MUXNEG_GND,
+    ac_ref_vscale = AC_COMPCTRL_MUXNEG_VSCALE,
+    ac_ref_bandgap = AC_COMPCTRL_MUXNEG_BANDGAP,
+    ac_ref_dac = AC_COMPCTRL_MUXNEG_DAC
+} ACReference_t;
+
+typedef enum
+{
+    ac_continuous, // Compares all the time, the output follows the inputs
+    ac_single_shot // One comparison per start()/read()
+} ACMode_t;
+
+typedef enum
+{
+    ac_int_toggle = AC_COMPCTRL_INTSEL_TOGGLE,
+    ac_int_rising = AC_COMPCTRL_INTSEL_RISING,
+    ac_int_falling = AC_COMPCTRL_INTSEL_FALLING,
+    ac_int_complete = AC_COMPCTRL_INTSEL_EOC // Every comparison
+} ACInterrupt_t;
+
+// Called from the AC interrupt with the comparator output
+typedef void ( *ACCallback_t )( bool state );
+
+// One of the two comparators. Positive inputs are the AC pins (AIN0..3 on
+// PA04..PA07), the negative input is another AC pin or an internal reference.
+// The comparator is picked when begin() is called. With runInStandby it
+// switches to low power and is clocked from GCLK1 (32kHz) so a crossing can
+// wake the CPU from deep sleep.
+class AnalogComparator
+{
+  public:
+    AnalogComparator( int32_t posPin, int32_t negPin );
+    AnalogComparator( int32_t posPin, ACReference_t ref,
+                      uint8_t scaler = 31 );
+
+    bool begin( ACMode_t mode = ac_continuous, bool hysteresis = false,
+                bool runInStandby = false );
+    void end();
+
+    // Continuous mode returns the output as it is, single shot runs a
+    // comparison and waits for it
+    bool read();
+    void start();
+    bool isReady();
+    void setScaler( uint8_t scaler );
+
+    void attachInterrupt( ACCallback_t  cb,
+                          ACInterrupt_t type = ac_int_toggle );
+    void detachInterrupt();
+
+    // Comparator output event, route it with the events helpers using the
+    // generator from getEventGenerator()
+    void     enableEvent( bool enable );
+    uint32_t getEventGenerator();
+
+    void onService();
+
+  private:
+    int32_t      _posPin;
+    int32_t      _negPin;
+    int8_t       _posInput;
+    uint32_t     _negInput;
+    uint8_t      _scaler;
+    int8_t       _num;
+    ACMode_t     _mode;
+    uint32_t     _compCtrl;
+    ACCallback_t _callback;
+
+    static int8_t acInput( int32_t pin );
+    void          writeCompCtrl( uint32_t compCtrl );
+};
+
+#endif /* ANALOGCOMPARATOR_H_ */
@@ -0,0 +1,203 @@
+/*
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stddef.h>
+#include "AnalogFilter.h"
+
+// Keeps outputs inside the range the next stage can multiply
+static inline int32_t saturate( int64_t x )
+{
+    if( x > ANALOG_FILTER_SAMPLE_MAX ) return ANALOG_FILTER_SAMPLE_MAX;
+    if( x < -ANALOG_FILTER_SAMPLE_MAX ) return -ANALOG_FILTER_SAMPLE_MAX;
+    return (int32_t)x;
+}
+
+AnalogDecimator::AnalogDecimator( uint8_t order, uint8_t decimationLog2,
+                                  uint8_t outputBits )
+{
+    int32_t shift = order * decimationLog2 + 12 - outputBits;
+
+    _order = order;
+    _log2R = decimationLog2;
+    _shift = shift > 0 ? (uint8_t)shift : 0;
+    _valid = order > 0 && order <= ANALOG_CIC_MAX_ORDER &&
+             order * decimationLog2 <= ANALOG_CIC_MAX_GROWTH;
+
+    reset();
+}
+
+void AnalogDecimator::reset()
+{
+    _phase = 0;
+    for( uint8_t i = 0; i < ANALOG_CIC_MAX_ORDER; i++ ) {
+        _integ[i] = 0;
+        _comb[i] = 0;
+    }
+}
+
+// One block through an ORDER stage CIC. The integrators are copied into locals
+// so they stay in registers across the block, and the order is fixed at
+// compile time so the stage loops unroll.
+template <int ORDER>
+static uint32_t cicBlock( uint32_t *integ, uint32_t *comb, uint32_t *phase,
+                          uint32_t mask, uint8_t shift, const int16_t *in,
+                          uint32_t count, int32_t *out )
+{
+    uint32_t acc[ORDER], ph = *phase, y, t, written = 0;
+    uint8_t  k;
+
+    for( k = 0; k < ORDER; k++ ) acc[k] = integ[k];
+
+    while( count-- ) {
+        acc[0] += (uint32_t)( *in++ );
+        for( k = 1; k < ORDER; k++ ) acc[k] += acc[k - 1];
+
+        // Combs run at the output rate
+        if( ( ++ph & mask ) == 0 ) {
+            y = acc[ORDER - 1];
+            for( k = 0; k < ORDER; k++ ) {
+                t = y;
+                y -= comb[k];
+                comb[k] = t;
+            }
+            out[written++] = (int32_t)y >> shift;
+        }
+    }
+
+    for( k = 0; k < ORDER; k++ ) integ[k] = acc[k];
+    *phase = ph;
+
+    return written;
+}
+
+uint32_t AnalogDecimator::process( const int16_t *in, uint32_t count,
+                                   int32_t *out )
+{
+    uint32_t mask = ( 1ul << _log2R ) - 1;
+
+    if( !_valid ) return 0;
+
+    switch( _order ) {
+        case 1:
+            return cicBlock<1>( _integ, _comb, &_phase, mask, _shift, in,
+                                count, out );
+        case 2:
+            return cicBlock<2>( _integ, _comb, &_phase, mask, _shift, in,
+                                count, out );
+        case 3:
+            return cicBlock<3>( _integ, _comb, &_phase, mask, _shift, in,
+                                count, out );
+        default:
+            return cicBlock<4>( _integ, _comb, &_phase, mask, _shift, in,
+                                count, out );
+    }
+}
+
+AnalogFIR::AnalogFIR( const int16_t *coeffs, uint8_t taps )
+{
+    _coeffs = coeffs;
+    _taps = taps;
+    if( coeffs == NULL || taps > ANALOG_FIR_MAX_TAPS ) _taps = 0;
+
+    reset();
+}
+
+void AnalogFIR::reset()
+{
+    _index = 0;
+    for( uint8_t i = 0; i < ANALOG_FIR_MAX_TAPS * 2; i++ ) _history[i] = 0;
+}
+
+void AnalogFIR::process( int32_t *buf, uint32_t count )
+{
+    const int16_t *c = _coeffs;
+    const int32_t *x;
+    uint8_t        taps = _taps, k;
+    int64_t        acc;
+
+    if( taps == 0 ) return;
+
+    while( count-- ) {
+        // Newest sample first so coefficient k lines up with x[n - k]
+        if( _index == 0 ) _index = taps;
+        _index--;
+        _history[_index] = _history[_index + taps] = *buf;
+        x = &_history[_index];
+
+        // 32 bit products (a single MULS), only the sum needs 64 bits
+        acc = 1 << 14;
+        for( k = 0; k < taps; k++ ) acc += (int32_t)( x[k] * c[k] );
+
+        acc >>= 15;
+        *buf++ = saturate( acc );
+    }
+}
+
+AnalogIIR::AnalogIIR( const AnalogBiquad_t *sections, uint8_t count )
+{
+    _sections = sections;
+    _count = count;
+    if( sections == NULL || count > ANALOG_IIR_MAX_SECTIONS ) _count = 0;
+
+    reset();
+}
+
+void AnalogIIR::reset()
+{
+    for( uint8_t i = 0; i < ANALOG_IIR_MAX_SECTIONS; i++ )
+        for( uint8_t j = 0; j < 4; j++ ) _state[i][j] = 0;
+}
+
+void AnalogIIR::process( int32_t *buf, uint32_t count )
+{
+    // Section by section over the whole block, so each section's coefficients
+    // and state are loaded once per block rather than once per sample
+    for( uint8_t s = 0; s < _count; s++ ) {
+        int32_t  b0 = _sections[s].b0, b1 = _sections[s].b1,
+                 b2 = _sections[s].b2, a1 = _sections[s].a1,
+                 a2 = _sections[s].a2;
+        int32_t  x1 = _state[s][0], x2 = _state[s][1];
+        int32_t  y1 = _state[s][2], y2 = _state[s][3];
+        int32_t  x, y;
+        int64_t  acc;
+        int32_t *p = buf;
+
+        for( uint32_t n = 0; n < count; n++ ) {
+            x = *p;
+
+            // Direct form I, 32 bit products summed in 64 bits
+            acc = 1 << 13;
+            acc += (int32_t)( b0 * x );
+            acc += (int32_t)( b1 * x1 );
+            acc += (int32_t)( b2 * x2 );
+            acc -= (int32_t)( a1 * y1 );
+            acc -= (int32_t)( a2 * y2 );
+            acc >>= 14;
+            y = saturate( acc );
+
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            *p++ = y;
+        }
+
+        _state[s][0] = x1;
+        _state[s][1] = x2;
+        _state[s][2] = y1;
+        _state[s][3] = y2;
+    }
+}
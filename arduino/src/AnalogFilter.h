@@ -0,0 +1,142 @@
+/*
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ANALOGFILTER_H_
+#define ANALOGFILTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "RingBuffer.h"
+
+// Limits for the software filters, state is kept inline so nothing is
+// allocated
+#define ANALOG_CIC_MAX_ORDER 4
+// order * log2( decimation ), the most a full scale 12 bit input can grow and
+// still fit an int32_t
+#define ANALOG_CIC_MAX_GROWTH 19
+#define ANALOG_FIR_MAX_TAPS 32
+#define ANALOG_IIR_MAX_SECTIONS 4
+
+// Streamed samples are cut into blocks of this size when draining a buffer
+#define ANALOG_FILTER_BLOCK_SIZE 32
+
+// Filter outputs are saturated to this so the next stage's products fit 32 bits
+#define ANALOG_FILTER_SAMPLE_MAX 65535
+
+// Biquad section in Q2.14, y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2
+typedef struct
+{
+    int16_t b0, b1, b2;
+    int16_t a1, a2;
+} AnalogBiquad_t;
+
+// CIC decimator for ADC results. Every 2^decimationLog2 inputs give one output
+// scaled to outputBits (of a 12 bit input), an order of 1 is a moving average.
+// Oversampling by 4^n gives n extra bits of resolution on a noisy input, so 16
+// bits out of the 12 bit ADC takes a decimation of 256 and order 1 or 2.
+class AnalogDecimator
+{
+  public:
+    AnalogDecimator( uint8_t order, uint8_t decimationLog2,
+                     uint8_t outputBits = 16 );
+
+    bool isValid()
+    {
+        return _valid;
+    }
+    void reset();
+
+    // Returns the number of outputs written, at most count / decimation + 1
+    uint32_t process( const int16_t *in, uint32_t count, int32_t *out );
+
+    // Drains buf (as filled by Analog::beginStream()) in blocks, stops early
+    // once maxOut outputs have been written
+    template <int N>
+    uint32_t process( RingBufferN<int16_t, N> *buf, int32_t *out,
+                      uint32_t maxOut )
+    {
+        int16_t  block[ANALOG_FILTER_BLOCK_SIZE];
+        uint32_t len, written = 0;
+        uint32_t perBlock = ( ANALOG_FILTER_BLOCK_SIZE >> _log2R ) + 1;
+
+        while( written + perBlock <= maxOut ) {
+            len = buf->GetNumObjStored();
+            if( len == 0 ) break;
+            if( len > ANALOG_FILTER_BLOCK_SIZE ) len = ANALOG_FILTER_BLOCK_SIZE;
+
+            buf->DeQueue( block, len );
+            written += process( block, len, &out[written] );
+        }
+
+        return written;
+    }
+
+  private:
+    uint8_t  _order;
+    uint8_t  _log2R;
+    uint8_t  _shift;
+    bool     _valid;
+    uint32_t _phase;
+
+    // Unsigned so the integrators wrap, the combs undo it
+    uint32_t _integ[ANALOG_CIC_MAX_ORDER];
+    uint32_t _comb[ANALOG_CIC_MAX_ORDER];
+};
+
+// FIR filter with Q1.15 coefficients, applied in place. Samples must stay
+// within +/-65535 (16 bits plus sign) so each product fits 32 bits, the sum
+// is kept in 64.
+class AnalogFIR
+{
+  public:
+    AnalogFIR( const int16_t *coeffs, uint8_t taps );
+
+    bool isValid()
+    {
+        return _taps > 0;
+    }
+    void reset();
+    void process( int32_t *buf, uint32_t count );
+
+  private:
+    const int16_t *_coeffs;
+    uint8_t        _taps;
+    uint8_t        _index;
+
+    // Every sample is stored twice so the taps never wrap
+    int32_t _history[ANALOG_FIR_MAX_TAPS * 2];
+};
+
+// Cascade of biquad sections, applied in place. The same +/-65535 limit as
+// AnalogFIR holds for the samples and for the output of every section.
+class AnalogIIR
+{
+  public:
+    AnalogIIR( const AnalogBiquad_t *sections, uint8_t count );
+
+    bool isValid()
+    {
+        return _count > 0;
+    }
+    void reset();
+    void process( int32_t *buf, uint32_t count );
+
+  private:
+    const AnalogBiquad_t *_sections;
+    uint8_t               _count;
+    int32_t               _state[ANALOG_IIR_MAX_SECTIONS][4];
+};
+
+#endif /* ANALOGFILTER_H_ */
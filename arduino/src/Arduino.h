@@ -80,13 +80,18 @@ void loop( void );
 #include "HardwareSerial.h"
 #include "pulse.h"
 #include "TimerCounter.h"
+#include "TimerWheel.h"
 #include "EEPROM.h"
 #include "PWM.h"
+#include "SoftPWM.h"
 #include "Analog.h"
+#include "AnalogFilter.h"
+#include "AnalogComparator.h"
 #endif /* __cplusplus */
 #include "delay.h"
 #include "debug_hooks.h"
 #include "clocks.h"
+#include "events.h"
 #include "RTC.h"
 #include "WDT.h"
 #include "NVM.h"
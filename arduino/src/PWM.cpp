@@ -37,6 +37,48 @@ void PWM::setDutyCycle( uint8_t dutyCycle )
     _timer->setPWMDutyCycle( CHECK_DUTY_CYCLE( dutyCycle ) );
 }
 
+bool PWM::beginDual( uint32_t frequency, uint16_t duty0, uint16_t duty1 )
+{
+    _timer->end();
+    return _timer->beginDualPWM( frequency, duty0, duty1 );
+}
+
+void PWM::setDuty( uint16_t duty, uint8_t channel )
+{
+    _timer->setPWMDuty( channel, duty );
+}
+
+bool PWM::setPin( int32_t pin )
+{
+    return _timer->setOutputPin( pin );
+}
+
+bool PWM::fade( uint16_t from, uint16_t to, uint32_t ms, TCFadeCurve_t curve,
+                TCFadeCallback_t cb, uint8_t channel )
+{
+    return _timer->fadePWM( channel, from, to, ms, curve, cb );
+}
+
+void PWM::stopFade( uint8_t channel )
+{
+    _timer->stopFade( channel );
+}
+
+bool PWM::isFading( uint8_t channel )
+{
+    return _timer->isFading( channel );
+}
+
+uint32_t PWM::getFrequency()
+{
+    return _timer->getOverflowFrequency();
+}
+
+uint8_t PWM::getResolution()
+{
+    return _timer->getPWMResolution();
+}
+
 void PWM::pause()
 {
     _timer->pause();
@@ -22,12 +22,42 @@
 #include <stdint.h>
 #include "TimerCounter.h"
 
+// Duty cycles as 16 bit fractions of the period, PWM_DUTY_MAX is the last
+// count of the period
+#define PWM_DUTY_MAX 0xFFFF
+
 class PWM
 {
   public:
     PWM( TimerCounter *tc );
+
+    // Duty cycle in percent on the timer's WO[1] pin, at any frequency
     void begin( uint32_t frequency, uint8_t dutyCycle );
     void setDutyCycle( uint8_t dutyCycle );
+
+    // Both of the timer's pins, see TimerCounter::beginDualPWM() for the
+    // frequencies and resolutions this gives
+    bool beginDual( uint32_t frequency, uint16_t duty0, uint16_t duty1 );
+
+    // Takes effect at the end of the channel's current pulse. Only channel 1
+    // is driven after begin().
+    void setDuty( uint16_t duty, uint8_t channel = 1 );
+
+    // Output pins are picked from the variant's timer functions, see
+    // TimerCounter::setOutputPin()
+    bool setPin( int32_t pin );
+
+    // Fades from one duty to another in the timer interrupt, see
+    // TimerCounter::fadePWM()
+    bool fade( uint16_t from, uint16_t to, uint32_t ms,
+               TCFadeCurve_t curve = tc_fade_linear, TCFadeCallback_t cb = NULL,
+               uint8_t channel = 1 );
+    void stopFade( uint8_t channel = 1 );
+    bool isFading( uint8_t channel = 1 );
+
+    uint32_t getFrequency();
+    uint8_t  getResolution(); // Bits of duty cycle the period can resolve
+
     void pause();
     void resume();
     void end();
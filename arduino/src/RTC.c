@@ -50,6 +50,15 @@ volatile RTCIRQ_Debug_t        _rtcIrqDebug = {0, 0, 0, 0};
 void ( *userOverFlowISR )() = 0;
 int ( *userIdleTaskHasWork )() = 0;
 
+// Armed alarms, soonest first, and the step COMP0 was last set for
+RTCAlarm_t *volatile _rtcAlarms = 0;
+volatile uint64_t    _rtcCompSteps;
+volatile uint8_t     _insideAlarm = 0;
+RTCAlarm_t           _delayAlarm;
+
+static void linkAlarm( RTCAlarm_t *alarm );
+static void unlinkAlarm( RTCAlarm_t *alarm );
+
 // Initializes the RTC with a 32768 Hz input clock source. The resolution of the
 //  RTC module is therefore 30.5 uS. The RTC overflow interrupt is set to
 //  trigger once ever 32768 clock cycles which is one overflow per second.
@@ -99,6 +108,8 @@ void disableRTC()
     enableAPBAClk( PM_APBAMASK_RTC, 0 );
     disableGenericClk( GCLK_CLKCTRL_ID_RTC_Val );
     _rtcOverFlows = 0;
+
+    while( _rtcAlarms != 0 ) unlinkAlarm( _rtcAlarms );
 }
 
 uint64_t stepsRTC()
@@ -189,33 +200,17 @@ void delayRTCStepsIdle( uint64_t steps, void ( *idleFunc )() )
                 _insideDelaySetup = 1;
                 _delayStepsDebug.sleepCounter++;
 
-                // Clear the compare interrupt flag
-                RTC->MODE1.INTFLAG.reg = RTC_MODE1_INTFLAG_CMP0;
-
-                // Account for the ~10 RTC cycles it takes to re-enable reads at
-                // the end of this section
-                ATOMIC_OPERATION( {
-                    if( RTC_SYNC_BUSY ) RTC_WAIT_SYNC;
-                    RTC->MODE1.COMP[0].reg = ( uint16_t )(
-                        ( ( _delayStepsDebug.internalDelay -
-                            RTC_CNT_READ_ENABLE_DELAY ) +
-                          ( _delayStepsDebug.cnt & RTC_STEPS_OVERFLOW ) ) &
-                        RTC_STEPS_OVERFLOW );
-                } )
-
-                // Enable the compare interrupt
-                RTC->MODE1.INTENSET.bit.CMP0 = 1;
-
-                // Sleep the CPU
-                sleepCPU( _deep_sleep );
-
-                // Disable the compare interrupt, keep the overflow interrupt
-                // enabled
-                uint32_t b = RTC->MODE1.INTENSET.reg;
-                if( b & RTC_MODE1_INTENSET_CMP0 ) {
-                    b &= ~RTC_MODE1_INTENCLR_OVF;
-                    RTC->MODE1.INTENCLR.reg = b;
-                }
+                // Wake through the alarm queue, accounting for the ~10 RTC
+                // cycles it takes to re-enable reads at the end of this
+                // section
+                startRTCAlarm( &_delayAlarm,
+                               _delayStepsDebug.start + _delayStepsDebug.steps -
+                                   RTC_CNT_READ_ENABLE_DELAY,
+                               0, 0 );
+
+                // Sleep the CPU, unless the alarm has gone off already
+                if( _delayAlarm.armed ) sleepCPU( _deep_sleep );
+                cancelRTCAlarm( &_delayAlarm );
 
                 // Writing to the compare register clears automatic reads,
                 // re-enable automatic reads. Takes ~10 RTC cycles
@@ -238,6 +233,127 @@ void registerOverflowISR( void ( *ISRFunc )() )
     userOverFlowISR = ISRFunc;
 }
 
+void startRTCAlarm( RTCAlarm_t *alarm, uint64_t steps,
+                    RTCAlarmCallback_t cb, uint64_t period )
+{
+    ATOMIC_OPERATION( {
+        if( alarm->armed ) unlinkAlarm( alarm );
+        alarm->steps = steps;
+        alarm->period = period;
+        alarm->callback = cb;
+        linkAlarm( alarm );
+    } )
+}
+
+void startRTCAlarmIn( RTCAlarm_t *alarm, uint64_t steps,
+                      RTCAlarmCallback_t cb, uint64_t period )
+{
+    startRTCAlarm( alarm, stepsRTC() + steps, cb, period );
+}
+
+uint8_t cancelRTCAlarm( RTCAlarm_t *alarm )
+{
+    uint8_t wasArmed;
+
+    // COMP0 is left alone, at worst it wakes up to a later alarm
+    ATOMIC_OPERATION( {
+        wasArmed = alarm->armed;
+        if( wasArmed ) unlinkAlarm( alarm );
+    } )
+
+    return wasArmed;
+}
+
+// Alarms are kept sorted, earliest first. A new head has the interrupt work
+// out COMP0 again.
+static void linkAlarm( RTCAlarm_t *alarm )
+{
+    RTCAlarm_t **pos = (RTCAlarm_t **)&_rtcAlarms;
+
+    while( *pos != 0 && ( *pos )->steps <= alarm->steps ) pos = &( *pos )->next;
+    alarm->next = *pos;
+    *pos = alarm;
+    alarm->armed = 1;
+
+    if( _rtcAlarms == alarm ) NVIC_SetPendingIRQ( RTC_IRQn );
+}
+
+static void unlinkAlarm( RTCAlarm_t *alarm )
+{
+    RTCAlarm_t **pos = (RTCAlarm_t **)&_rtcAlarms;
+
+    while( *pos != 0 && *pos != alarm ) pos = &( *pos )->next;
+    if( *pos == alarm ) *pos = alarm->next;
+    alarm->next = 0;
+    alarm->armed = 0;
+}
+
+// stepsRTC() for the interrupt, which can't use the debug values a call it
+// interrupted is working in. An overflow not yet counted shows as its flag.
+static uint64_t alarmSteps()
+{
+    uint32_t before, after;
+    uint16_t count;
+
+    do {
+        before = RTC->MODE1.INTFLAG.reg & RTC_MODE1_INTFLAG_OVF;
+        count = RTC->MODE1.COUNT.reg;
+        after = RTC->MODE1.INTFLAG.reg & RTC_MODE1_INTFLAG_OVF;
+    } while( before != after || count >= ( RTC_STEPS_OVERFLOW - 6 ) );
+
+    return ( ( _rtcOverFlows + ( after ? 1 : 0 ) ) << 15 ) | count;
+}
+
+// Runs the alarms that are due, then puts the low bits of the next one in
+// COMP0 once it falls within the current overflow. Called from
+// RTC_IRQHandler().
+static void serviceAlarms()
+{
+    RTCAlarm_t *alarm;
+    uint64_t    steps;
+
+    while( _rtcAlarms != 0 ) {
+        alarm = _rtcAlarms;
+        steps = alarmSteps();
+
+        if( steps >= alarm->steps ) {
+            // Periodic alarms are re-armed first so the callback can cancel
+            unlinkAlarm( alarm );
+            if( alarm->period != 0 ) {
+                alarm->steps += alarm->period;
+                linkAlarm( alarm );
+            }
+            if( alarm->callback != 0 ) alarm->callback( alarm );
+            continue;
+        }
+
+        // Later overflows are picked up by the overflow interrupt
+        if( ( alarm->steps >> 15 ) != ( steps >> 15 ) ) {
+            RTC->MODE1.INTENCLR.reg = RTC_MODE1_INTENCLR_CMP0;
+            break;
+        }
+
+        // Already waiting for it
+        if( _rtcCompSteps == alarm->steps &&
+            ( RTC->MODE1.INTENSET.reg & RTC_MODE1_INTENSET_CMP0 ) )
+            break;
+
+        if( RTC_SYNC_BUSY ) RTC_WAIT_SYNC;
+        RTC->MODE1.COMP[0].reg = (uint16_t)( alarm->steps & RTC_STEPS_OVERFLOW );
+        RTC->MODE1.INTFLAG.reg = RTC_MODE1_INTFLAG_CMP0;
+        RTC->MODE1.INTENSET.reg = RTC_MODE1_INTENSET_CMP0;
+        _rtcCompSteps = alarm->steps;
+
+        // Writing the compare register stops the continuous reads, and the
+        // count may have gone past it while the write synchronised
+        RTC_SET_READS
+        RTC_WAIT_SYNC;
+        if( alarmSteps() < alarm->steps ) break;
+    }
+
+    if( _rtcAlarms == 0 ) RTC->MODE1.INTENCLR.reg = RTC_MODE1_INTENCLR_CMP0;
+}
+
 void registerIdleTaskHasWork( int ( *Func )() )
 {
     userIdleTaskHasWork = Func;
@@ -291,5 +407,14 @@ void RTC_IRQHandler()
     }
 
     RTC->MODE1.INTFLAG.reg = _rtcIrqDebug.irqFlags;
+
+    // Checked on every interrupt against the whole step count. stepsRTC()
+    // runs this handler itself on an overflow, which may interrupt it.
+    if( !_insideAlarm ) {
+        _insideAlarm = 1;
+        serviceAlarms();
+        _insideAlarm = 0;
+    }
+
     _rtcIrqDebug.inside = 0;
 }
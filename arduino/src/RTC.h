@@ -56,6 +56,20 @@ typedef struct
     uint8_t  userISRCalled, maxOVF, inside;
 } RTCIRQ_Debug_t;
 
+typedef struct RTCAlarm_s RTCAlarm_t;
+
+// Called from the RTC interrupt when an alarm goes off
+typedef void ( *RTCAlarmCallback_t )( RTCAlarm_t *alarm );
+
+struct RTCAlarm_s
+{
+    RTCAlarm_t *       next;
+    uint64_t           steps; // Absolute, as from stepsRTC()
+    uint64_t           period; // 0 for one shot
+    RTCAlarmCallback_t callback;
+    uint8_t            armed;
+};
+
 void     initRTC();
 void     disableRTC();
 uint64_t stepsRTC();
@@ -63,6 +77,19 @@ uint64_t secondsRTC();
 void     delayRTCSteps( uint64_t steps );
 void     delayRTCStepsIdle( uint64_t steps, void ( *idleFunc )() );
 void     registerOverflowISR( void ( *ISRFunc )() );
+
+// Any number of alarms queued on COMP0, each called back from the RTC
+// interrupt once stepsRTC() has reached its steps. The RTC runs in standby
+// so alarms wake the CPU from deep sleep. Alarms are owned by the caller
+// and must start out zeroed, as globals and statics are. A periodic alarm
+// is re-armed before its callback, which can cancel or restart it.
+// Restarting an armed alarm moves it, and one with no callback just wakes
+// the CPU.
+void    startRTCAlarm( RTCAlarm_t *alarm, uint64_t steps, RTCAlarmCallback_t cb,
+                       uint64_t period );
+void    startRTCAlarmIn( RTCAlarm_t *alarm, uint64_t steps,
+                         RTCAlarmCallback_t cb, uint64_t period );
+uint8_t cancelRTCAlarm( RTCAlarm_t *alarm ); // Returns 0 if it wasn't armed
 void     registerIdleTaskHasWork( int ( *Func )() );
 void getRTCDebugInfo( RTCSteps_Debug_t *steps, DelayRTCSteps_Debug_t *dSteps,
                       RTCIRQ_Debug_t *irqSteps );
@@ -20,12 +20,6 @@
 #include "variant.h"
 #include <Arduino.h>
 
-#ifndef WIRE_RISE_TIME_NANOSECONDS
-// Default rise time in nanoseconds, based on 4.7K ohm pull up resistors
-// you can override this value in your variant if needed
-#define WIRE_RISE_TIME_NANOSECONDS 125
-#endif
-
 #define UART_SYNC_BUSY ( sercom->USART.STATUS.bit.SYNCBUSY )
 #define UART_WAIT_SYNC while( UART_SYNC_BUSY )
 
@@ -38,10 +32,15 @@
 #define I2CS_SYNC_BUSY ( sercom->I2CS.STATUS.bit.SYNCBUSY )
 #define I2CS_WAIT_SYNC while( I2CS_SYNC_BUSY )
 
+#define WIRE_TIMED_OUT( start ) \
+    ( ( micros() - ( start ) ) > WIRE_TIMEOUT_MICROS )
+
 SERCOM::SERCOM( Sercom *s )
 {
     sercom = s;
     _mode = MODE_NONE;
+    _baudrateWIRE = 0;
+    _timedOutWIRE = false;
 }
 
 bool SERCOM::sercomIRQEN()
@@ -463,14 +462,20 @@ void SERCOM::initSlaveWIRE( uint8_t ucAddress, bool enableGeneralCall )
             SERCOM_I2CS_ADDR_GENCEN; // enable general call (address 0x00)
     }
 
+    // Smart mode, reading DATA sends the prepared ACK/NACK and writing DATA
+    // releases the clock, so each byte only needs a single register access
+    sercom->I2CS.CTRLB.reg = SERCOM_I2CS_CTRLB_SMEN;
+
     // Set the interrupt register
     sercom->I2CS.INTENSET.reg = SERCOM_I2CS_INTENSET_PREC |   // Stop
                                 SERCOM_I2CS_INTENSET_AMATCH | // Address Match
                                 SERCOM_I2CS_INTENSET_DRDY;    // Data Ready
 }
 
-void SERCOM::initMasterWIRE( uint32_t baudrate )
+void SERCOM::initMasterWIRE( uint32_t baudrate, uint32_t riseTimeNs )
 {
+    uint8_t baud, baudLow;
+
     if( _mode < MODE_NONE ) takeDownMode();
     _mode = MODE_WIRE;
 
@@ -492,10 +497,69 @@ void SERCOM::initMasterWIRE( uint32_t baudrate )
     //  SERCOM_I2CM_INTENSET_SB | SERCOM_I2CM_INTENSET_ERROR ;
 
     // Synchronous arithmetic baudrate
-    sercom->I2CM.BAUD.bit.BAUD =
-        SystemCoreClock / ( 2 * baudrate ) - 5 -
-        ( ( ( SystemCoreClock / 1000000 ) * WIRE_RISE_TIME_NANOSECONDS ) /
-          ( 2 * 1000 ) );
+    _baudrateWIRE = calculateBaudrateWIRE( baudrate, riseTimeNs, &baud,
+                                           &baudLow );
+    sercom->I2CM.BAUD.reg =
+        SERCOM_I2CM_BAUD_BAUD( baud ) | SERCOM_I2CM_BAUD_BAUDLOW( baudLow );
+}
+
+// Works out BAUD/BAUDLOW for the requested SCL frequency from the current
+// SystemCoreClock (the SERCOM runs from GCLK0) and the bus rise time, and
+// returns the SCL frequency that will actually be produced. The period is
+// rounded up so the bus never runs faster than requested.
+//
+//  BAUDLOW == 0 : fSCL = f / ( 10 + 2 * BAUD + f * Trise )
+//  BAUDLOW != 0 : fSCL = f / ( 10 + BAUD + BAUDLOW + f * Trise )
+//
+// Standard mode uses a symmetric clock. Fast mode and fast mode plus split the
+// period with BAUDLOW so the SCL low time meets the specification minimum
+// (1.3us and 0.5us) and the high time gets what is left.
+uint32_t SERCOM::calculateBaudrateWIRE( uint32_t baudrate, uint32_t riseTimeNs,
+                                        uint8_t *baud, uint8_t *baudLow )
+{
+    uint32_t fRef = SystemCoreClock;
+    int32_t  riseCycles, total, lowMin, high, low;
+
+    if( baudrate == 0 ) baudrate = 100000;
+
+    riseCycles = (int32_t)( ( (uint64_t)fRef * riseTimeNs + 999999999ull ) /
+                            1000000000ull );
+    total = (int32_t)( ( fRef + baudrate - 1 ) / baudrate ) - 10 - riseCycles;
+
+    if( baudrate <= 100000 ) {
+        high = ( total + 1 ) / 2;
+        if( high < 1 ) high = 1;
+        if( high > 255 ) high = 255;
+
+        *baud = (uint8_t)high;
+        *baudLow = 0;
+        return fRef / ( 10 + 2 * high + riseCycles );
+    }
+
+    // The SCL low time is BAUDLOW + 5 reference clocks
+    lowMin = ( baudrate <= 400000 ) ? WIRE_FM_TLOW_NANOSECONDS
+                                    : WIRE_FMPLUS_TLOW_NANOSECONDS;
+    lowMin = (int32_t)( ( (uint64_t)fRef * lowMin + 999999999ull ) /
+                        1000000000ull ) -
+             5;
+
+    low = ( total + 1 ) / 2;
+    if( low < lowMin ) low = lowMin;
+    if( low < 1 ) low = 1;
+    if( low > 255 ) low = 255;
+
+    high = total - low;
+    if( high < 1 ) high = 1;
+    if( high > 255 ) high = 255;
+
+    *baud = (uint8_t)high;
+    *baudLow = (uint8_t)low;
+    return fRef / ( 10 + high + low + riseCycles );
+}
+
+uint32_t SERCOM::getBaudrateWIRE( void )
+{
+    return _baudrateWIRE;
 }
 
 void SERCOM::prepareNackBitWIRE( void )
@@ -539,12 +603,20 @@ void SERCOM::prepareCommandBitsWire( uint8_t cmd )
 bool SERCOM::startTransmissionWIRE( uint8_t                 address,
                                     SercomWireReadWriteFlag flag )
 {
+    uint32_t start = micros();
+
     // 7-bits address + 1-bits R/W
     address = ( address << 0x1ul ) | flag;
+    _timedOutWIRE = false;
 
     // Wait idle or owner bus mode
-    while( !isBusIdleWIRE() && !isBusOwnerWIRE() )
-        ;
+    while( !isBusIdleWIRE() && !isBusOwnerWIRE() ) {
+        if( WIRE_TIMED_OUT( start ) ) {
+            _timedOutWIRE = true;
+            return false;
+        }
+    }
+    start = micros();
 
     // Send start and address
     sercom->I2CM.ADDR.bit.ADDR = address;
@@ -554,6 +626,10 @@ bool SERCOM::startTransmissionWIRE( uint8_t                 address,
     {
         while( !sercom->I2CM.INTFLAG.bit.MB ) {
             // Wait transmission complete
+            if( WIRE_TIMED_OUT( start ) ) {
+                _timedOutWIRE = true;
+                return false;
+            }
         }
     }
     else // Read mode
@@ -569,6 +645,10 @@ bool SERCOM::startTransmissionWIRE( uint8_t                 address,
                 return false;
             }
             // Wait transmission complete
+            if( WIRE_TIMED_OUT( start ) ) {
+                _timedOutWIRE = true;
+                return false;
+            }
         }
 
         // Clean the 'Slave on Bus' flag, for further usage.
@@ -586,7 +666,10 @@ bool SERCOM::startTransmissionWIRE( uint8_t                 address,
 
 bool SERCOM::sendDataMasterWIRE( uint8_t data )
 {
+    uint32_t start = micros();
+
     // Send data
+    _timedOutWIRE = false;
     sercom->I2CM.DATA.bit.DATA = data;
 
     // Wait transmission successful
@@ -597,6 +680,12 @@ bool SERCOM::sendDataMasterWIRE( uint8_t data )
         if( sercom->I2CM.STATUS.bit.BUSERR ) {
             return false;
         }
+
+        // A slave holding the clock low will never finish the byte
+        if( WIRE_TIMED_OUT( start ) ) {
+            _timedOutWIRE = true;
+            return false;
+        }
     }
 
     // Problems on line? nack received?
@@ -679,8 +768,15 @@ int SERCOM::availableWIRE( void )
 uint8_t SERCOM::readDataWIRE( void )
 {
     if( isMasterWIRE() ) {
+        uint32_t start = micros();
+
+        _timedOutWIRE = false;
         while( sercom->I2CM.INTFLAG.bit.SB == 0 ) {
-            // Waiting complete receive
+            // Waiting complete receive, a stuck bus reads as all ones
+            if( WIRE_TIMED_OUT( start ) ) {
+                _timedOutWIRE = true;
+                return 0xFF;
+            }
         }
 
         return sercom->I2CM.DATA.bit.DATA;
@@ -690,6 +786,68 @@ uint8_t SERCOM::readDataWIRE( void )
     }
 }
 
+// Non-blocking address send, the result is reported through the MB (write, or
+// NACK on read) and SB (read) interrupt flags
+void SERCOM::sendAddressWIRE( uint8_t address, SercomWireReadWriteFlag flag )
+{
+    sercom->I2CM.ADDR.bit.ADDR = ( address << 0x1ul ) | flag;
+}
+
+// Non-blocking data send, completion is reported through the MB flag
+void SERCOM::writeDataMasterWIRE( uint8_t data )
+{
+    sercom->I2CM.DATA.bit.DATA = data;
+}
+
+bool SERCOM::isMasterOnBusWIRE( void )
+{
+    return sercom->I2CM.INTFLAG.bit.MB;
+}
+
+bool SERCOM::isSlaveOnBusWIRE( void )
+{
+    return sercom->I2CM.INTFLAG.bit.SB;
+}
+
+bool SERCOM::isBusErrorWIRE( void )
+{
+    return sercom->I2CM.STATUS.bit.BUSERR;
+}
+
+bool SERCOM::isArbitrationLostWIRE( void )
+{
+    return sercom->I2CM.STATUS.bit.ARBLOST;
+}
+
+void SERCOM::enableInterruptsMasterWIRE( void )
+{
+    sercom->I2CM.INTENSET.reg =
+        SERCOM_I2CM_INTENSET_MB | SERCOM_I2CM_INTENSET_SB;
+}
+
+void SERCOM::disableInterruptsMasterWIRE( void )
+{
+    sercom->I2CM.INTENCLR.reg =
+        SERCOM_I2CM_INTENCLR_MB | SERCOM_I2CM_INTENCLR_SB;
+}
+
+void SERCOM::clearStopDetectedWIRE( void )
+{
+    sercom->I2CS.INTFLAG.reg = SERCOM_I2CS_INTFLAG_PREC;
+}
+
+// Slave transmit in smart mode, writing DATA clears DRDY and releases the bus
+void SERCOM::writeDataSlaveWIRE( uint8_t data )
+{
+    sercom->I2CS.DATA.reg = data;
+}
+
+// True when the last blocking start, send or read gave up waiting on the bus
+bool SERCOM::hasTimedOutWIRE( void )
+{
+    return _timedOutWIRE;
+}
+
 void SERCOM::enableSERCOM()
 {
     uint32_t id = GCLK_CLKCTRL_ID_SERCOM0_CORE_Val;
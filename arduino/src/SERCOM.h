@@ -23,6 +23,22 @@
 
 #define SERCOM_NVIC_PRIORITY ( ( 1 << __NVIC_PRIO_BITS ) - 1 )
 
+#ifndef WIRE_RISE_TIME_NANOSECONDS
+// Default rise time in nanoseconds, based on 4.7K ohm pull up resistors
+// you can override this value in your variant if needed
+#define WIRE_RISE_TIME_NANOSECONDS 125
+#endif
+
+#ifndef WIRE_TIMEOUT_MICROS
+// Longest we'll wait on the bus (one byte, or the bus going idle) before
+// giving up, long enough for a slave stretching the clock
+#define WIRE_TIMEOUT_MICROS 25000ul
+#endif
+
+// Minimum SCL low times from the I2C specification
+#define WIRE_FM_TLOW_NANOSECONDS 1300
+#define WIRE_FMPLUS_TLOW_NANOSECONDS 500
+
 typedef enum
 {
     UART_EXT_CLOCK = 0,
@@ -202,7 +218,12 @@ class SERCOM
 
     /* ========== WIRE ========== */
     void initSlaveWIRE( uint8_t address, bool enableGeneralCall = false );
-    void initMasterWIRE( uint32_t baudrate );
+    void initMasterWIRE( uint32_t baudrate,
+                         uint32_t riseTimeNs = WIRE_RISE_TIME_NANOSECONDS );
+    static uint32_t calculateBaudrateWIRE( uint32_t baudrate,
+                                           uint32_t riseTimeNs, uint8_t *baud,
+                                           uint8_t *baudLow );
+    uint32_t        getBaudrateWIRE( void );
 
     void resetWIRE( void );
     void enableWIRE( void );
@@ -226,10 +247,23 @@ class SERCOM
     bool isRXNackReceivedWIRE( void );
     int  availableWIRE( void );
     uint8_t readDataWIRE( void );
+    void    sendAddressWIRE( uint8_t address, SercomWireReadWriteFlag flag );
+    void    writeDataMasterWIRE( uint8_t data );
+    bool    isMasterOnBusWIRE( void );
+    bool    isSlaveOnBusWIRE( void );
+    bool    isBusErrorWIRE( void );
+    bool    isArbitrationLostWIRE( void );
+    void    enableInterruptsMasterWIRE( void );
+    void    disableInterruptsMasterWIRE( void );
+    void    clearStopDetectedWIRE( void );
+    void    writeDataSlaveWIRE( uint8_t data );
+    bool    hasTimedOutWIRE( void );
 
   private:
     Sercom *   sercom;
     SercomMode _mode;
+    uint32_t   _baudrateWIRE;
+    bool       _timedOutWIRE;
     uint8_t    calculateBaudrateSynchronous( uint32_t baudrate );
     uint32_t   division( uint32_t dividend, uint32_t divisor );
     void       enableSERCOM();
@@ -0,0 +1,235 @@
+/*
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+#include "SoftPWM.h"
+#include "atomic.h"
+
+// Running engines, the timer interrupt only takes a plain function so each
+// entry gets its own
+static SoftPWM *_softPWMs[SOFT_PWM_MAX] = {NULL, NULL, NULL, NULL};
+
+template <int N>
+static void softPWMISR()
+{
+    if( _softPWMs[N] != NULL ) _softPWMs[N]->onService();
+}
+
+static void ( *const _softPWMISRs[SOFT_PWM_MAX] )() = {
+    softPWMISR<0>, softPWMISR<1>, softPWMISR<2>, softPWMISR<3>};
+
+SoftPWM::SoftPWM( TimerCounter *timer )
+{
+    _timer = timer;
+    _num = -1;
+    _channels = 0;
+    _frequency = 0;
+    _period = 0;
+    _minGap = 1;
+    _active = 0;
+    _pending = false;
+    _next = 0;
+    _edgeCount[0] = 0;
+    _edgeCount[1] = 0;
+}
+
+bool SoftPWM::begin( uint32_t frequency )
+{
+    TCPlan_t plan;
+    uint32_t div;
+    uint8_t  n;
+
+    if( _timer == NULL || _num != -1 || frequency == 0 ) return false;
+
+    for( n = 0; n < SOFT_PWM_MAX; n++ )
+        if( _softPWMs[n] == NULL ) break;
+    if( n == SOFT_PWM_MAX ) return false;
+
+    // The counter wraps at every edge, the period is the most counts between
+    // two of them
+    plan = planTCWrap( SystemCoreClock, frequency, CC_16_BIT_MAX );
+    if( plan.frequency == 0 ) return false;
+
+    div = tcPrescalerDiv( plan.prescaler );
+    _minGap = SOFT_PWM_MARGIN_CYCLES / div + 1;
+    if( plan.period < 4 * _minGap ) return false;
+
+    _num = n;
+    _softPWMs[n] = this;
+    _period = plan.period;
+    _frequency = SystemCoreClock / ( div * plan.period );
+    _next = 0;
+
+    // Duties set before begin() couldn't be placed without a period
+    build();
+
+    _timer->registerISR( _softPWMISRs[n] );
+    _timer->begin( plan, false, tc_mode_16_bit, true );
+
+    return true;
+}
+
+void SoftPWM::end()
+{
+    if( _num == -1 ) return;
+
+    _timer->end();
+    _timer->deregisterISR();
+    _softPWMs[_num] = NULL;
+    _num = -1;
+
+    for( uint8_t i = 0; i < _channels; i++ ) digitalWrite( _pins[i], LOW );
+}
+
+bool SoftPWM::attach( uint32_t pin, uint16_t duty )
+{
+    if( pin >= PINS_COUNT || gArduinoPins[pin].port == NOT_A_PORT ||
+        gArduinoPins[pin].port >= SOFT_PWM_PORTS )
+        return false;
+    if( findChannel( pin ) != -1 ) return setDuty( pin, duty );
+    if( _channels == SOFT_PWM_MAX_CHANNELS ) return false;
+
+    digitalWrite( pin, LOW );
+    pinMode( pin, OUTPUT );
+
+    _pins[_channels] = pin;
+    _duty[_channels] = duty;
+    _channels++;
+    build();
+
+    return true;
+}
+
+bool SoftPWM::detach( uint32_t pin )
+{
+    int8_t ch = findChannel( pin );
+
+    if( ch == -1 ) return false;
+
+    // Off for a period first so the interrupt leaves the pin alone after
+    setDuty( pin, 0 );
+    if( _num != -1 ) {
+        while( _pending )
+            ;
+    }
+
+    _channels--;
+    _pins[ch] = _pins[_channels];
+    _duty[ch] = _duty[_channels];
+    build();
+    digitalWrite( pin, LOW );
+
+    return true;
+}
+
+bool SoftPWM::setDuty( uint32_t pin, uint16_t duty )
+{
+    int8_t ch = findChannel( pin );
+
+    if( ch == -1 ) return false;
+
+    _duty[ch] = duty;
+    build();
+
+    return true;
+}
+
+void SoftPWM::onService()
+{
+    const SoftPWMEdge_t *edge;
+
+    // New duties are picked up at the start of a period
+    if( _next == 0 && _pending ) {
+        _active ^= 1;
+        _pending = false;
+    }
+
+    edge = &_edges[_active][_next];
+    for( uint8_t p = 0; p < SOFT_PWM_PORTS; p++ ) {
+        if( edge->clr[p] != 0 ) PORT->Group[p].OUTCLR.reg = edge->clr[p];
+        if( edge->set[p] != 0 ) PORT->Group[p].OUTSET.reg = edge->set[p];
+    }
+    _timer->setPeriod( edge->gap );
+
+    if( ++_next >= _edgeCount[_active] ) _next = 0;
+}
+
+int8_t SoftPWM::findChannel( uint32_t pin )
+{
+    for( uint8_t i = 0; i < _channels; i++ )
+        if( _pins[i] == pin ) return i;
+    return -1;
+}
+
+// Sorts the channels by duty and writes their edges into the buffer the
+// interrupt isn't using, it switches over at the start of the next period
+void SoftPWM::build()
+{
+    SoftPWMEdge_t *edges;
+    uint8_t        order[SOFT_PWM_MAX_CHANNELS], count, port, ch, i, j;
+    uint32_t       t, last, mask;
+
+    if( _period == 0 ) return;
+
+    // The interrupt only switches buffers while one is pending
+    ATOMIC_OPERATION( { _pending = false; } )
+    edges = _edges[_active ^ 1];
+    memset( edges, 0, sizeof( _edges[0] ) );
+
+    for( i = 0; i < _channels; i++ ) {
+        for( j = i; j > 0 && _duty[order[j - 1]] > _duty[i]; j-- )
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    // Every pin is set or cleared at the start of the period, those in
+    // between are cleared at their own edge
+    count = 1;
+    last = 0;
+    for( i = 0; i < _channels; i++ ) {
+        ch = order[i];
+        port = gArduinoPins[_pins[ch]].port;
+        mask = 1ul << gArduinoPins[_pins[ch]].pin;
+
+        if( _duty[ch] == 0 ) {
+            edges[0].clr[port] |= mask;
+            continue;
+        }
+        edges[0].set[port] |= mask;
+        if( _duty[ch] == PWM_DUTY_MAX ) continue;
+
+        t = ( (uint32_t)_duty[ch] * _period ) >> 16;
+        if( t > _period - _minGap ) t = _period - _minGap;
+        if( t < _minGap ) t = _minGap;
+
+        // Too close to the last edge to wake up for separately
+        if( t >= last + _minGap ) {
+            edges[count - 1].gap = t - last;
+            last = t;
+            count++;
+        }
+        edges[count - 1].clr[port] |= mask;
+    }
+    edges[count - 1].gap = _period - last;
+    _edgeCount[_active ^ 1] = count;
+
+    ATOMIC_OPERATION( {
+        if( _num == -1 )
+            _active ^= 1;
+        else
+            _pending = true;
+    } )
+}
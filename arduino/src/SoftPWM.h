@@ -0,0 +1,95 @@
+/*
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef SOFTPWM_H_
+#define SOFTPWM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "TimerCounter.h"
+#include "PWM.h"
+
+#define SOFT_PWM_MAX_CHANNELS 16
+#define SOFT_PWM_MAX 4 // Engines running at once, one per TimerCounter
+#define SOFT_PWM_PORTS 2
+
+#define SOFT_PWM_FREQUENCY 500
+
+// CPU cycles from the counter wrapping to the next period being written.
+// Edges closer together than this are merged, which limits how close to 0
+// and to full a duty can get.
+#define SOFT_PWM_MARGIN_CYCLES 200
+
+// One edge of the period, the pins to clear and set then and the counts to
+// the next edge
+typedef struct
+{
+    uint32_t clr[SOFT_PWM_PORTS];
+    uint32_t set[SOFT_PWM_PORTS];
+    uint32_t gap;
+} SoftPWMEdge_t;
+
+// PWM on any output pin, driven from one TimerCounter interrupt. Channels
+// are sorted by duty cycle and those switching off together are grouped
+// into one edge, so every edge is one OUTCLR (and the start of the period
+// one OUTSET) per port however many channels there are. The counter wraps
+// at each edge rather than every count.
+class SoftPWM
+{
+  public:
+    SoftPWM( TimerCounter *timer );
+
+    // The period is planned to fit the 16 bit counter, getSteps() is how
+    // many counts it came out at
+    bool begin( uint32_t frequency = SOFT_PWM_FREQUENCY );
+    void end(); // Leaves every channel's pin low
+
+    // Duty cycles as for PWM, 0 is off and PWM_DUTY_MAX is on for the whole
+    // period. Changes take effect from the start of the next period.
+    bool attach( uint32_t pin, uint16_t duty = 0 );
+    bool detach( uint32_t pin ); // The pin is left low
+    bool setDuty( uint32_t pin, uint16_t duty );
+
+    uint32_t getFrequency()
+    {
+        return _frequency;
+    }
+    uint32_t getSteps()
+    {
+        return _period;
+    }
+
+    void onService();
+
+  private:
+    TimerCounter *   _timer;
+    int8_t           _num;
+    uint8_t          _channels;
+    uint8_t          _pins[SOFT_PWM_MAX_CHANNELS];
+    uint16_t         _duty[SOFT_PWM_MAX_CHANNELS];
+    uint32_t         _frequency;
+    uint32_t         _period;
+    uint32_t         _minGap;
+    SoftPWMEdge_t    _edges[2][SOFT_PWM_MAX_CHANNELS + 1];
+    uint8_t          _edgeCount[2];
+    volatile uint8_t _active;
+    volatile bool    _pending;
+    uint8_t          _next;
+
+    int8_t findChannel( uint32_t pin );
+    void   build();
+};
+
+#endif /* SOFTPWM_H_ */
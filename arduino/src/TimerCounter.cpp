@@ -22,53 +22,230 @@
 #include "clocks.h"
 #include "WVariant.h"
 
-#define CC_8_BIT_MAX 0xFF
-#define CC_16_BIT_MAX 0xFFFF
-#define CC_32_BIT_MAX 0xFFFFFFFF
-
 #define TIMER_NVIC_PRIORITY ( ( 1 << __NVIC_PRIO_BITS ) - 1 )
 
+// Planner checks, exact rates have to come out with no error and on the
+// smallest prescaler that reaches them
+static_assert( planTCFrequency( 48000000ul, 1000, CC_16_BIT_MAX ).period ==
+                       24000 &&
+                   planTCFrequency( 48000000ul, 1000, CC_16_BIT_MAX ).ppm == 0,
+               "1kHz at 48MHz" );
+static_assert( planTCFrequency( 8000000ul, 1, CC_16_BIT_MAX ).prescaler ==
+                       TC_CTRLA_PRESCALER_DIV64_Val &&
+                   planTCFrequency( 8000000ul, 1, CC_16_BIT_MAX ).period ==
+                       62500,
+               "1Hz at 8MHz, 16 bit" );
+static_assert( planTCFrequency( 8000000ul, 1, CC_32_BIT_MAX ).prescaler ==
+                       TC_CTRLA_PRESCALER_DIV1_Val &&
+                   planTCFrequency( 8000000ul, 1, CC_32_BIT_MAX ).period ==
+                       4000000ul,
+               "1Hz at 8MHz, 32 bit" );
+static_assert( planTCFrequency( 32768ul, 1, CC_8_BIT_MAX ).frequency == 1 &&
+                   planTCFrequency( 32768ul, 1, CC_8_BIT_MAX ).ppm == 0,
+               "1Hz at 32kHz, 8 bit" );
+static_assert( planTCWrap( 48000000ul, 3, CC_16_BIT_MAX ).period == 62500 &&
+                   planTCWrap( 48000000ul, 3, CC_16_BIT_MAX ).ppm == 0,
+               "3Hz wrap at 48MHz" );
+
+// TC wired to each pair of port pins on the timer function, the even pin of a
+// pair is WO[0] and the odd one WO[1]
+static const int8_t _tcPinPairs[][16] = {
+    {-1, -1, 0, 1, 0, 1, 2, 3, 2, 3, 7, 4, 5, -1, -1, -1}, // PA00..PA31
+    {7, 6, -1, -1, 4, 5, 4, 5, 6, -1, -1, 7, -1, -1, -1, 0} // PB00..PB31
+};
+
+// Gamma 2.2 and 2^x sampled at 33 points across 0..1 in Q16, in between is
+// interpolated. Fade curves are walked linearly in the space these map from.
+static const uint16_t _gammaTable[33] = {
+    0,     32,    147,   359,   676,   1104,  1648,  2314,  3104,
+    4022,  5072,  6255,  7574,  9033,  10632, 12375, 14263, 16298,
+    18482, 20816, 23303, 25943, 28739, 31692, 34802, 38072, 41503,
+    45097, 48853, 52774, 56860, 61114, 65535};
+static const uint32_t _exp2Table[33] = {
+    65536,  66971,  68438,  69936,  71468,  73032,  74632,  76266,  77936,
+    79642,  81386,  83169,  84990,  86851,  88752,  90696,  92682,  94711,
+    96785,  98905,  101070, 103283, 105545, 107856, 110218, 112631, 115098,
+    117618, 120194, 122825, 125515, 128263, 131072};
+
+// Table value at a Q16 position
+static uint32_t tableAt( const uint16_t *t16, const uint32_t *t32,
+                         uint32_t pos )
+{
+    uint32_t i = pos >> 11, frac = pos & 0x7FF, a, b;
+
+    if( i >= 32 ) return t16 != NULL ? t16[32] : t32[32];
+    a = t16 != NULL ? t16[i] : t32[i];
+    b = t16 != NULL ? t16[i + 1] : t32[i + 1];
+    return a + ( ( ( b - a ) * frac ) >> 11 );
+}
+
+// Q16 position of a value, the inverse of tableAt()
+static uint32_t tablePos( const uint16_t *t16, const uint32_t *t32,
+                          uint32_t val )
+{
+    uint32_t i, a, b;
+
+    for( i = 0; i < 31; i++ ) {
+        b = t16 != NULL ? t16[i + 1] : t32[i + 1];
+        if( val < b ) break;
+    }
+    a = t16 != NULL ? t16[i] : t32[i];
+    b = t16 != NULL ? t16[i + 1] : t32[i + 1];
+    if( val > b ) val = b;
+
+    return ( i << 11 ) + ( ( val - a ) << 11 ) / ( b - a );
+}
+
+// Duty to its position along a curve and back
+static int32_t fadeToCurve( TCFadeCurve_t curve, uint16_t duty )
+{
+    uint32_t n;
+
+    switch( curve ) {
+        case tc_fade_gamma: return tablePos( _gammaTable, NULL, duty );
+        case tc_fade_exponential:
+            // log2, the mantissa normalised to 1..2 in Q16
+            if( duty == 0 ) duty = 1;
+            n = 31 - __builtin_clz( duty );
+            return ( n << 16 ) +
+                   tablePos( NULL, _exp2Table, (uint32_t)duty << ( 16 - n ) );
+        default: return duty;
+    }
+}
+
+static uint16_t fadeFromCurve( TCFadeCurve_t curve, int32_t pos )
+{
+    uint32_t m;
+
+    switch( curve ) {
+        case tc_fade_gamma: return tableAt( _gammaTable, NULL, pos );
+        case tc_fade_exponential:
+            // The mantissa is under 2^17, shifted down before it can overflow
+            m = tableAt( NULL, _exp2Table, pos & 0xFFFF );
+            return m >> ( 16 - ( pos >> 16 ) );
+        default: return pos;
+    }
+}
+
 TimerCounter::TimerCounter( Tc *timerCounter )
 {
     _timerCounter = timerCounter;
 
-    if( _timerCounter == TC2 ) {
+    if( _timerCounter == TC0 ) {
+        _APBCMask = PM_APBCMASK_TC0;
+        _clkID = GCLK_CLKCTRL_ID_TC0_TC1_Val;
+        _irqn = (uint32_t)TC0_IRQn;
+        _tcNum = 0;
+        _outPin = TC0_OUTPIN;
+        _pwmPin = TC0_PWMPIN;
+    }
+    else if( _timerCounter == TC1 ) {
+        _APBCMask = PM_APBCMASK_TC1;
+        _clkID = GCLK_CLKCTRL_ID_TC0_TC1_Val;
+        _irqn = (uint32_t)TC1_IRQn;
+        _tcNum = 1;
+        _outPin = TC1_OUTPIN;
+        _pwmPin = TC1_PWMPIN;
+    }
+    else if( _timerCounter == TC2 ) {
         _APBCMask = PM_APBCMASK_TC2;
         _clkID = GCLK_CLKCTRL_ID_TC2_TC3_Val;
         _irqn = (uint32_t)TC2_IRQn;
         _tcNum = 2;
+        _outPin = TC2_OUTPIN;
+        _pwmPin = TC2_PWMPIN;
     }
     else if( _timerCounter == TC3 ) {
         _APBCMask = PM_APBCMASK_TC3;
         _clkID = GCLK_CLKCTRL_ID_TC2_TC3_Val;
         _irqn = (uint32_t)TC3_IRQn;
         _tcNum = 3;
+        _outPin = TC3_OUTPIN;
+        _pwmPin = TC3_PWMPIN;
     }
     else if( _timerCounter == TC4 ) {
         _APBCMask = PM_APBCMASK_TC4;
         _clkID = GCLK_CLKCTRL_ID_TC4_TC5_Val;
         _irqn = (uint32_t)TC4_IRQn;
         _tcNum = 4;
+        _outPin = TC4_OUTPIN;
+        _pwmPin = TC4_PWMPIN;
     }
     else if( _timerCounter == TC5 ) {
         _APBCMask = PM_APBCMASK_TC5;
         _clkID = GCLK_CLKCTRL_ID_TC4_TC5_Val;
         _irqn = (uint32_t)TC5_IRQn;
         _tcNum = 5;
+        _outPin = TC5_OUTPIN;
+        _pwmPin = TC5_PWMPIN;
     }
     else {
         _APBCMask = 0;
         _clkID = 0;
         _irqn = 0;
         _tcNum = -1;
+        _outPin = -1;
+        _pwmPin = -1;
     }
 
     isrPtr = NULL;
     _mode = tc_mode_16_bit;
     _ccVal = 0;
     _ctrlA = 0;
+    _clkFreq = 0;
+    _plan.frequency = 0;
+    _plan.ppm = 0;
     _isPaused = false;
     _isActive = false;
+
+    _capturing = false;
+    _captureChannel = -1;
+    _captureCallback = NULL;
+
+    _pwmOutputs = 0;
+    _pwmTop = 0;
+    _fade[0].active = false;
+    _fade[1].active = false;
+    _fadeDiv = 1;
+    _fadeCount = 0;
+
+    // Defaults that don't match the chip are dropped rather than muxed
+    if( _outPin != -1 && getPinChannel( _outPin ) != 0 ) _outPin = -1;
+    if( _pwmPin != -1 && getPinChannel( _pwmPin ) != 1 ) _pwmPin = -1;
+}
+
+int8_t TimerCounter::getPinChannel( int32_t pin )
+{
+    const ArduinoGPIO_t *gpio;
+
+    if( _tcNum == -1 || pin < 0 || pin >= PINS_COUNT ) return -1;
+
+    gpio = &gArduinoPins[pin];
+    if( gpio->port == NOT_A_PORT || gpio->port > PORTB || gpio->timer == -1 )
+        return -1;
+    if( _tcPinPairs[gpio->port][gpio->pin >> 1] != _tcNum ) return -1;
+
+    return gpio->pin & 1;
+}
+
+bool TimerCounter::setOutputPin( int32_t pin )
+{
+    int8_t channel = getPinChannel( pin );
+
+    if( channel == -1 || _isActive ) return false;
+
+    if( channel == 0 )
+        _outPin = pin;
+    else
+        _pwmPin = pin;
+
+    return true;
+}
+
+int8_t TimerCounter::getOutputPin( uint8_t channel )
+{
+    if( channel > 1 ) return -1;
+    return channel == 0 ? _outPin : _pwmPin;
 }
 
 void TimerCounter::registerISR( void ( *isr )() )
@@ -83,62 +260,301 @@ void TimerCounter::deregisterISR()
 
 void TimerCounter::beginPWM( uint32_t frequency, uint8_t dutyCycle )
 {
-    begin( frequency / 2, false, tc_mode_16_bit, false );
+    beginWrap( frequency, tc_mode_16_bit, false );
     pause();
 
     // Set wave generation
     _timerCounter->COUNT16.CTRLA.bit.WAVEGEN = TC_CTRLA_WAVEGEN_MPWM_Val;
     waitRegSync();
 
-    // Duty cycle
+    // Duty cycle, written straight away while paused
+    _pwmOutputs = 1;
+    _pwmTop = _ccVal;
     setPWMDutyCycle( dutyCycle );
 
-    switch( _tcNum ) {
-        case 2: pinMode( 6, gArduinoPins[6].timer ); break;
-        case 3: pinMode( 4, gArduinoPins[4].timer ); break;
-        case 4: pinMode( 10, gArduinoPins[10].timer ); break;
-        case 5: pinMode( 0, gArduinoPins[0].timer ); break;
+    if( _pwmPin != -1 ) pinMode( _pwmPin, gArduinoPins[_pwmPin].timer );
+
+    NVIC_ClearPendingIRQ( (IRQn_Type)_irqn );
+    NVIC_EnableIRQ( (IRQn_Type)_irqn );
+    resume();
+}
+
+bool TimerCounter::beginDualPWM( uint32_t frequency, uint16_t duty0,
+                                 uint16_t duty1 )
+{
+    TCPlan_t plan, next;
+    TCMode_t mode;
+    uint32_t div;
+
+    if( _clkID == 0 || frequency == 0 ) return false;
+
+    // The period is the whole counter, only the prescaler moves the
+    // frequency
+    mode = tc_mode_16_bit;
+    plan = {0, CC_16_BIT_MAX + 1, 0, INT32_MAX};
+    for( uint8_t p = 0; p < 8; p++ ) {
+        next.prescaler = p;
+        next.period = CC_16_BIT_MAX + 1;
+        next.frequency = 0;
+        next.ppm = tcClampPpm(
+            tcErrorPpm( SystemCoreClock, frequency,
+                        (uint64_t)tcPrescalerDiv( p ) * next.period ) );
+        plan = tcPlanBetter( plan, next );
     }
 
+    // Too far off, PER as the top gets closer with 8 bits
+    if( plan.ppm > TC_DUAL_PWM_MAX_ERROR ||
+        plan.ppm < -TC_DUAL_PWM_MAX_ERROR ) {
+        mode = tc_mode_8_bit;
+        plan = planTCWrap( SystemCoreClock, frequency, CC_8_BIT_MAX );
+        if( plan.ppm > TC_DUAL_PWM_MAX_ERROR ||
+            plan.ppm < -TC_DUAL_PWM_MAX_ERROR )
+            return false;
+    }
+
+    // The PWM frequency, truncated as getOverflowFrequency() gives it
+    div = tcPrescalerDiv( plan.prescaler );
+    plan.frequency = SystemCoreClock / ( div * plan.period );
+
+    begin( plan, false, mode, false );
+    pause();
+
+    _timerCounter->COUNT16.CTRLA.bit.WAVEGEN = TC_CTRLA_WAVEGEN_NPWM_Val;
+    waitRegSync();
+    if( mode == tc_mode_8_bit ) {
+        _timerCounter->COUNT8.PER.reg = _ccVal;
+        waitRegSync();
+    }
+
+    _pwmOutputs = 2;
+    _pwmTop = _ccVal;
+    setPWMDuty( 0, duty0 );
+    setPWMDuty( 1, duty1 );
+
+    if( _outPin != -1 ) pinMode( _outPin, gArduinoPins[_outPin].timer );
+    if( _pwmPin != -1 ) pinMode( _pwmPin, gArduinoPins[_pwmPin].timer );
+
+    NVIC_ClearPendingIRQ( (IRQn_Type)_irqn );
+    NVIC_EnableIRQ( (IRQn_Type)_irqn );
     resume();
+
+    return true;
+}
+
+void TimerCounter::setPWMDuty( uint8_t channel, uint16_t duty )
+{
+    stopFade( channel );
+    queuePWMDuty( channel, duty );
+}
+
+void TimerCounter::queuePWMDuty( uint8_t channel, uint16_t duty )
+{
+    uint32_t cc, mask;
+
+    // In single channel mode CC[0] is the period
+    if( channel > 1 || _pwmOutputs == 0 ) return;
+    if( channel == 0 && _pwmOutputs == 1 ) return;
+
+    cc = ( (uint32_t)duty * ( _pwmTop + 1 ) ) >> 16;
+    mask = TC_INTFLAG_MC0 << channel;
+
+    ATOMIC_OPERATION( {
+        if( _isPaused ) {
+            writePWMCC( channel, cc );
+            _timerCounter->COUNT16.INTENCLR.reg = mask;
+        }
+        else {
+            _pwmNext[channel] = cc;
+            _timerCounter->COUNT16.INTFLAG.reg = mask;
+            _timerCounter->COUNT16.INTENSET.reg = mask;
+        }
+    } )
+}
+
+uint32_t TimerCounter::getPWMSteps()
+{
+    return _pwmOutputs == 0 ? 0 : _pwmTop + 1;
+}
+
+uint8_t TimerCounter::getPWMResolution()
+{
+    return _pwmOutputs == 0 ? 0 : 31 - __builtin_clz( _pwmTop + 1 );
+}
+
+bool TimerCounter::fadePWM( uint8_t channel, uint16_t from, uint16_t to,
+                            uint32_t ms, TCFadeCurve_t curve,
+                            TCFadeCallback_t cb )
+{
+    TCFade_t *fade;
+    uint32_t rate, steps;
+    int32_t  start;
+
+    if( channel > 1 || _pwmOutputs == 0 ) return false;
+    if( channel == 0 && _pwmOutputs == 1 ) return false;
+
+    // Both channels step together, so the first fade sets the rate
+    rate = getOverflowFrequency();
+    if( !_fade[0].active && !_fade[1].active ) {
+        _fadeDiv = ( rate + TC_FADE_RATE - 1 ) / TC_FADE_RATE;
+        if( _fadeDiv == 0 ) _fadeDiv = 1;
+        _fadeCount = 0;
+    }
+    steps = (uint64_t)ms * ( rate / _fadeDiv ) / 1000;
+    if( steps == 0 ) steps = 1;
+
+    stopFade( channel );
+    queuePWMDuty( channel, from );
+
+    fade = &_fade[channel];
+    start = fadeToCurve( curve, from );
+    fade->pos = start * 256;
+    fade->delta =
+        ( ( fadeToCurve( curve, to ) - start ) * 256 ) / (int32_t)steps;
+    fade->stepsLeft = steps;
+    fade->to = to;
+    fade->curve = curve;
+    _fadeCallback[channel] = cb;
+
+    ATOMIC_OPERATION( {
+        fade->active = true;
+        if( !( _timerCounter->COUNT16.INTENSET.reg & TC_INTFLAG_OVF ) ) {
+            _timerCounter->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+            _timerCounter->COUNT16.INTENSET.reg = TC_INTFLAG_OVF;
+        }
+    } )
+
+    return true;
+}
+
+void TimerCounter::stopFade( uint8_t channel )
+{
+    if( channel > 1 ) return;
+    _fade[channel].active = false;
+}
+
+bool TimerCounter::isFading( uint8_t channel )
+{
+    return channel < 2 && _fade[channel].active;
+}
+
+void TimerCounter::fadeService()
+{
+    TCFade_t *fade;
+
+    if( ++_fadeCount < _fadeDiv ) return;
+    _fadeCount = 0;
+
+    for( uint8_t ch = 0; ch < 2; ch++ ) {
+        fade = &_fade[ch];
+        if( !fade->active ) continue;
+
+        // The last step lands on the end duty exactly
+        if( --fade->stepsLeft == 0 ) {
+            fade->active = false;
+            queuePWMDuty( ch, fade->to );
+            if( _fadeCallback[ch] != NULL ) _fadeCallback[ch]( ch );
+            continue;
+        }
+
+        fade->pos += fade->delta;
+        queuePWMDuty( ch, fadeFromCurve( fade->curve, fade->pos >> 8 ) );
+    }
+
+    if( !_fade[0].active && !_fade[1].active )
+        _timerCounter->COUNT16.INTENCLR.reg = TC_INTFLAG_OVF;
+}
+
+void TimerCounter::pwmService()
+{
+    uint8_t  flags, mask;
+    uint32_t count;
+
+    flags = _timerCounter->COUNT16.INTFLAG.reg &
+            _timerCounter->COUNT16.INTENSET.reg;
+
+    if( flags & TC_INTFLAG_OVF ) {
+        _timerCounter->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+        fadeService();
+    }
+
+    for( uint8_t ch = 0; ch < 2; ch++ ) {
+        mask = TC_INTFLAG_MC0 << ch;
+        if( !( flags & mask ) ) continue;
+        _timerCounter->COUNT16.INTFLAG.reg = mask;
+
+        // The output went low at the match. If the counter has wrapped since,
+        // the output is high again and a value it has already passed would
+        // keep it high for the whole period, so wait for the next match.
+        count = getCount();
+        if( _pwmNext[ch] <= count && count < _pwmCC[ch] ) continue;
+
+        writePWMCC( ch, _pwmNext[ch] );
+        _timerCounter->COUNT16.INTENCLR.reg = mask;
+    }
+}
+
+void TimerCounter::writePWMCC( uint8_t channel, uint32_t cc )
+{
+    _pwmCC[channel] = cc;
+    if( _mode == tc_mode_8_bit )
+        _timerCounter->COUNT8.CC[channel].reg = cc;
+    else
+        _timerCounter->COUNT16.CC[channel].reg = cc;
+    waitRegSync();
+}
+
+static uint32_t tcMaxCC( TCMode_t mode )
+{
+    switch( mode ) {
+        case tc_mode_8_bit: return CC_8_BIT_MAX;
+        case tc_mode_16_bit: return CC_16_BIT_MAX;
+        default: return CC_32_BIT_MAX;
+    }
 }
 
 void TimerCounter::begin( uint32_t frequency, bool output, TCMode_t mode,
-                          bool useInterrupts )
+                          bool useInterrupts, bool runInStandby )
+{
+    begin( planTCFrequency( runInStandby ? TC_STANDBY_CLK_FREQ
+                                         : SystemCoreClock,
+                            frequency, tcMaxCC( mode ) ),
+           output, mode, useInterrupts, runInStandby );
+}
+
+void TimerCounter::beginWrap( uint32_t rate, TCMode_t mode, bool useInterrupts,
+                              bool runInStandby )
 {
-    _maxFreq = SystemCoreClock / 2;
+    begin( planTCWrap( runInStandby ? TC_STANDBY_CLK_FREQ : SystemCoreClock,
+                       rate, tcMaxCC( mode ) ),
+           false, mode, useInterrupts, runInStandby );
+}
+
+void TimerCounter::begin( const TCPlan_t &plan, bool output, TCMode_t mode,
+                          bool useInterrupts, bool runInStandby )
+{
+    uint32_t standby = runInStandby ? TC_CTRLA_RUNSTDBY : 0;
+
+    _clkFreq = runInStandby ? TC_STANDBY_CLK_FREQ : SystemCoreClock;
     _mode = mode;
 
     if( _clkID == 0 ) return;
-    enableAPBCClk( _APBCMask, 1 );
-    initGenericClk( GCLK_CLKCTRL_GEN_GCLK0_Val, _clkID );
+    enableAPBCClk( apbcMask(), 1 );
+    initGenericClk( runInStandby ? GCLK_CLKCTRL_GEN_GCLK1_Val
+                                 : GCLK_CLKCTRL_GEN_GCLK0_Val,
+                    _clkID );
     if( useInterrupts ) NVIC_EnableIRQ( (IRQn_Type)_irqn );
-    if( output ) {
-        switch( _tcNum ) {
-            case 2:
-                pinMode( TC2_OUTPIN, gArduinoPins[TC2_OUTPIN].timer );
-                break;
-            case 3:
-                pinMode( TC3_OUTPIN, gArduinoPins[TC3_OUTPIN].timer );
-                break;
-            case 4:
-                pinMode( TC4_OUTPIN, gArduinoPins[TC4_OUTPIN].timer );
-                break;
-            case 5:
-                pinMode( TC5_OUTPIN, gArduinoPins[TC5_OUTPIN].timer );
-                break;
-        }
-    }
+    if( output && _outPin != -1 )
+        pinMode( _outPin, gArduinoPins[_outPin].timer );
 
     // SWRST
     reset();
 
     switch( mode ) {
         case tc_mode_8_bit:
-            _ctrlA = TC_CTRLA_MODE_COUNT8;
+            _ctrlA = TC_CTRLA_MODE_COUNT8 | standby;
 
             // Configure period, and pre-scalers
-            setDividerAndCC( frequency, CC_8_BIT_MAX );
+            setDividerAndCC( plan );
             _timerCounter->COUNT8.CC[0].reg = (uint8_t)_ccVal;
             waitRegSync();
 
@@ -155,10 +571,10 @@ void TimerCounter::begin( uint32_t frequency, bool output, TCMode_t mode,
 
             break;
         case tc_mode_16_bit:
-            _ctrlA = TC_CTRLA_MODE_COUNT16;
+            _ctrlA = TC_CTRLA_MODE_COUNT16 | standby;
 
             // Configure period, and pre-scalers
-            setDividerAndCC( frequency, CC_16_BIT_MAX );
+            setDividerAndCC( plan );
             _timerCounter->COUNT16.CC[0].reg = (uint16_t)_ccVal;
             waitRegSync();
 
@@ -177,11 +593,11 @@ void TimerCounter::begin( uint32_t frequency, bool output, TCMode_t mode,
         case tc_mode_32_bit:
             if( ( _tcNum % 2 ) != 0 ) return;
 
-            _ctrlA = TC_CTRLA_MODE_COUNT32;
+            _ctrlA = TC_CTRLA_MODE_COUNT32 | standby;
 
             // Configure period, and pre-scalers
-            setDividerAndCC( frequency, CC_32_BIT_MAX );
-            _timerCounter->COUNT32.CC[0].reg = (uint8_t)_ccVal;
+            setDividerAndCC( plan );
+            _timerCounter->COUNT32.CC[0].reg = _ccVal;
             waitRegSync();
 
             // Enable compare capture interrupt 0
@@ -202,66 +618,49 @@ void TimerCounter::begin( uint32_t frequency, bool output, TCMode_t mode,
     _isActive = true;
 }
 
+// CTRLA, STATUS and the interrupt registers are the same in every counter
+// mode, so those are accessed through the 16 bit view below rather than
+// switching on the mode
 void TimerCounter::reset()
 {
-    switch( _mode ) {
-        case tc_mode_8_bit:
-            _timerCounter->COUNT8.CTRLA.reg = TC_CTRLA_SWRST;
-            while( _timerCounter->COUNT8.CTRLA.bit.SWRST )
-                ;
-            break;
-        case tc_mode_16_bit:
-            _timerCounter->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
-            while( _timerCounter->COUNT16.CTRLA.bit.SWRST )
-                ;
-            break;
-        case tc_mode_32_bit:
-            if( ( _tcNum % 2 ) == 0 ) {
-                _timerCounter->COUNT32.CTRLA.reg = TC_CTRLA_SWRST;
-                while( _timerCounter->COUNT32.CTRLA.bit.SWRST )
-                    ;
-            }
-            break;
+    if( _mode != tc_mode_32_bit || ( _tcNum % 2 ) == 0 ) {
+        _timerCounter->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+        while( _timerCounter->COUNT16.CTRLA.bit.SWRST )
+            ;
     }
 
     _ctrlA = 0;
     _ccVal = 0;
     _isPaused = false;
+    _pwmOutputs = 0;
+    _fade[0].active = false;
+    _fade[1].active = false;
 }
 
 void TimerCounter::end()
 {
+    if( _pwmOutputs != 0 && _pwmPin != -1 ) pinMode( _pwmPin, TRI_STATE );
     reset();
     _isActive = false;
 
-    switch( _tcNum ) {
-        case 2: pinMode( 5, TRI_STATE ); break;
-        case 3: pinMode( 3, TRI_STATE ); break;
-        case 4: pinMode( 9, TRI_STATE ); break;
-        case 5: pinMode( 1, TRI_STATE ); break;
-    }
+    if( _outPin != -1 ) pinMode( _outPin, TRI_STATE );
 
     NVIC_DisableIRQ( (IRQn_Type)_irqn );
-    disableGenericClk( _clkID );
-    enableAPBCClk( _APBCMask, 0 );
+
+    // The generic clock stays on while the other TC of the pair has its bus
+    // clock, it's begun and not ended even if paused
+    if( _mode == tc_mode_32_bit ||
+        ( PM->APBCMASK.reg & pairAPBCMask() ) == 0 )
+        disableGenericClk( _clkID );
+    enableAPBCClk( apbcMask(), 0 );
 }
 
 void TimerCounter::resume()
 {
     if( _isPaused ) {
         _isPaused = false;
-        switch( _mode ) {
-            case tc_mode_8_bit:
-                _timerCounter->COUNT8.CTRLA.bit.ENABLE = 1;
-                break;
-            case tc_mode_16_bit:
-                _timerCounter->COUNT16.CTRLA.bit.ENABLE = 1;
-                break;
-            case tc_mode_32_bit:
-                if( ( _tcNum % 2 ) == 0 )
-                    _timerCounter->COUNT32.CTRLA.bit.ENABLE = 1;
-                break;
-        }
+        if( _mode != tc_mode_32_bit || ( _tcNum % 2 ) == 0 )
+            _timerCounter->COUNT16.CTRLA.bit.ENABLE = 1;
 
         waitRegSync();
     }
@@ -271,18 +670,8 @@ void TimerCounter::pause()
 {
     if( !_isPaused ) {
         _isPaused = true;
-        switch( _mode ) {
-            case tc_mode_8_bit:
-                _timerCounter->COUNT8.CTRLA.bit.ENABLE = 0;
-                break;
-            case tc_mode_16_bit:
-                _timerCounter->COUNT16.CTRLA.bit.ENABLE = 0;
-                break;
-            case tc_mode_32_bit:
-                if( ( _tcNum % 2 ) == 0 )
-                    _timerCounter->COUNT32.CTRLA.bit.ENABLE = 0;
-                break;
-        }
+        if( _mode != tc_mode_32_bit || ( _tcNum % 2 ) == 0 )
+            _timerCounter->COUNT16.CTRLA.bit.ENABLE = 0;
 
         waitRegSync();
     }
@@ -290,12 +679,17 @@ void TimerCounter::pause()
 
 void TimerCounter::IrqHandler()
 {
-    switch( _mode ) {
-        case tc_mode_8_bit: _timerCounter->COUNT8.INTFLAG.bit.MC0 = 1; break;
-        case tc_mode_16_bit: _timerCounter->COUNT16.INTFLAG.bit.MC0 = 1; break;
-        case tc_mode_32_bit: _timerCounter->COUNT32.INTFLAG.bit.MC0 = 1; break;
+    if( _capturing ) {
+        captureService();
+        return;
+    }
+    if( _pwmOutputs != 0 ) {
+        pwmService();
+        return;
     }
 
+    // Writing the whole register leaves the other flags alone
+    _timerCounter->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
     if( isrPtr != NULL ) isrPtr();
 }
 
@@ -326,65 +720,267 @@ void TimerCounter::setCount( uint32_t count )
     waitRegSync();
 }
 
-void TimerCounter::setPWMDutyCycle( uint8_t dutyCycle )
+void TimerCounter::setPeriod( uint32_t counts )
 {
-    // Set duty cycle
-    uint32_t cc0 = _timerCounter->COUNT16.CC[0].reg;
-    uint32_t cc1 = ( ( cc0 << 8 ) * dutyCycle ) / 100;
-    cc1 >>= 8;
-    _timerCounter->COUNT16.CC[1].reg = cc1;
+    _ccVal = counts - 1;
+    switch( _mode ) {
+        case tc_mode_8_bit:
+            _timerCounter->COUNT8.CC[0].reg = _ccVal & CC_8_BIT_MAX;
+            break;
+        case tc_mode_16_bit:
+            _timerCounter->COUNT16.CC[0].reg = _ccVal & CC_16_BIT_MAX;
+            break;
+        case tc_mode_32_bit: _timerCounter->COUNT32.CC[0].reg = _ccVal; break;
+    }
+
     waitRegSync();
 }
 
-void TimerCounter::setDividerAndCC( uint32_t freq, uint32_t maxCC )
+bool TimerCounter::isMatchPending()
 {
-    uint32_t preScaleBits = 0;
-
-    _ctrlA |= TC_CTRLA_WAVEGEN_MFRQ; // Toggle mode
+    // The interrupt flags sit in the same place in every counter mode
+    return _timerCounter->COUNT16.INTFLAG.bit.MC0;
+}
 
-    _ccVal = _maxFreq / freq - 1;
-    preScaleBits = TC_CTRLA_PRESCALER_DIV1;
+void TimerCounter::setPWMDutyCycle( uint8_t dutyCycle )
+{
+    if( dutyCycle > 100 ) dutyCycle = 100;
+    setPWMDuty( 1, ( dutyCycle * 0xFFFFul ) / 100 );
+}
 
-    uint8_t i = 0;
+uint32_t TimerCounter::getOverflowFrequency()
+{
+    // Division for each PRESCALER field value
+    static const uint16_t divs[] = {1, 2, 4, 8, 16, 64, 256, 1024};
+    uint32_t              div;
 
-    while( i <= 9 ) {
-        _ccVal = _maxFreq / freq / ( 2 << i ) - 1;
-        if( _ccVal < maxCC ) break;
-        i++;
-        if( i == 4 || i == 6 ||
-            i == 8 ) // DIV32 DIV128 and DIV512 are not available
-            i++;
-    }
+    if( !_isActive ) return 0;
 
-    switch( i ) {
-        case 0: preScaleBits = TC_CTRLA_PRESCALER_DIV2; break;
-        case 1: preScaleBits = TC_CTRLA_PRESCALER_DIV4; break;
-        case 2: preScaleBits = TC_CTRLA_PRESCALER_DIV8; break;
-        case 3: preScaleBits = TC_CTRLA_PRESCALER_DIV16; break;
-        case 5: preScaleBits = TC_CTRLA_PRESCALER_DIV64; break;
-        case 7: preScaleBits = TC_CTRLA_PRESCALER_DIV256; break;
-        case 9: preScaleBits = TC_CTRLA_PRESCALER_DIV1024; break;
-        default: break;
-    }
-
-    _ctrlA |= preScaleBits;
+    div = divs[( _ctrlA & TC_CTRLA_PRESCALER_Msk ) >> TC_CTRLA_PRESCALER_Pos];
+    return _clkFreq / div / ( _ccVal + 1 );
 }
 
-void TimerCounter::waitRegSync()
+void TimerCounter::enableOverflowEvent( bool enable )
 {
+    bool wasPaused = _isPaused;
+
+    // The event control register can only be changed while disabled
+    pause();
     switch( _mode ) {
         case tc_mode_8_bit:
-            while( _timerCounter->COUNT8.STATUS.bit.SYNCBUSY )
-                ;
+            _timerCounter->COUNT8.EVCTRL.bit.OVFEO = enable;
             break;
         case tc_mode_16_bit:
-            while( _timerCounter->COUNT16.STATUS.bit.SYNCBUSY )
-                ;
+            _timerCounter->COUNT16.EVCTRL.bit.OVFEO = enable;
             break;
         case tc_mode_32_bit:
-            if( ( _tcNum % 2 ) == 0 )
-                while( _timerCounter->COUNT32.STATUS.bit.SYNCBUSY )
-                    ;
+            _timerCounter->COUNT32.EVCTRL.bit.OVFEO = enable;
             break;
     }
+    if( !wasPaused ) resume();
+}
+
+uint32_t TimerCounter::getOverflowEventGenerator()
+{
+    switch( _tcNum ) {
+        case 0: return EVSYS_ID_GEN_TC0_OVF;
+        case 1: return EVSYS_ID_GEN_TC1_OVF;
+        case 2: return EVSYS_ID_GEN_TC2_OVF;
+        case 3: return EVSYS_ID_GEN_TC3_OVF;
+        case 4: return EVSYS_ID_GEN_TC4_OVF;
+        case 5: return EVSYS_ID_GEN_TC5_OVF;
+    }
+
+    return 0;
+}
+
+bool TimerCounter::beginCapture( uint32_t pin, TCCapture_t action,
+                                 TCMode_t mode, uint8_t prescaler,
+                                 bool invert )
+{
+    int8_t   line;
+    uint32_t evCtrl;
+
+    if( _clkID == 0 || _capturing || mode == tc_mode_8_bit ) return false;
+    if( mode == tc_mode_32_bit && ( _tcNum % 2 ) != 0 ) return false;
+
+    // The TC needs the pin level rather than its edges, it finds the edges
+    // itself. The asynchronous path passes the level straight through.
+    line = attachInterruptEvent( pin, HIGH );
+    if( line == -1 ) return false;
+
+    _captureChannel = allocEventChannel();
+    if( _captureChannel == -1 ) {
+        detachInterruptEvent( pin );
+        return false;
+    }
+
+    initEventChannel( _captureChannel, EVSYS_ID_GEN_EIC_EXTINT_0 + line,
+                      EVSYS_CHANNEL_PATH_ASYNCHRONOUS_Val,
+                      EVSYS_CHANNEL_EDGSEL_NO_EVT_OUTPUT_Val );
+    attachEventUser( _captureChannel, EVSYS_ID_USER_TC0_EVU + _tcNum );
+
+    _clkFreq = SystemCoreClock;
+    _mode = mode;
+    enableAPBCClk( apbcMask(), 1 );
+    initGenericClk( GCLK_CLKCTRL_GEN_GCLK0_Val, _clkID );
+
+    // SWRST
+    reset();
+
+    _capturePin = pin;
+    _captureAction = action;
+    _captureReady = false;
+    _captureOverflow = true; // The first period starts mid count
+    _captureErrors = 0;
+
+    // Count freely to the top, the event restarts the count every period
+    _ctrlA = TC_CTRLA_WAVEGEN_NFRQ | TC_CTRLA_PRESCALER( prescaler & 0x7 );
+    evCtrl = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT( action );
+    if( invert ) evCtrl |= TC_EVCTRL_TCINV;
+
+    // The period lands in CC0 for PPW and CC1 for PWP, that capture marks
+    // the end of a cycle
+    if( mode == tc_mode_16_bit ) {
+        _ctrlA |= TC_CTRLA_MODE_COUNT16;
+        _timerCounter->COUNT16.CTRLC.reg = TC_CTRLC_CPTEN0 | TC_CTRLC_CPTEN1;
+        waitRegSync();
+        _timerCounter->COUNT16.EVCTRL.reg = evCtrl;
+        _timerCounter->COUNT16.INTENSET.reg =
+            ( action == tc_capture_ppw ? TC_INTENSET_MC0 : TC_INTENSET_MC1 ) |
+            TC_INTENSET_OVF | TC_INTENSET_ERR;
+        _timerCounter->COUNT16.READREQ.bit.RCONT = 1;
+    }
+    else {
+        _ctrlA |= TC_CTRLA_MODE_COUNT32;
+        _timerCounter->COUNT32.CTRLC.reg = TC_CTRLC_CPTEN0 | TC_CTRLC_CPTEN1;
+        waitRegSync();
+        _timerCounter->COUNT32.EVCTRL.reg = evCtrl;
+        _timerCounter->COUNT32.INTENSET.reg =
+            ( action == tc_capture_ppw ? TC_INTENSET_MC0 : TC_INTENSET_MC1 ) |
+            TC_INTENSET_OVF | TC_INTENSET_ERR;
+        _timerCounter->COUNT32.READREQ.bit.RCONT = 1;
+    }
+
+    _capturing = true;
+    NVIC_ClearPendingIRQ( (IRQn_Type)_irqn );
+    NVIC_EnableIRQ( (IRQn_Type)_irqn );
+
+    // Enable the module
+    _ctrlA |= TC_CTRLA_ENABLE;
+    if( mode == tc_mode_16_bit )
+        _timerCounter->COUNT16.CTRLA.reg = _ctrlA;
+    else
+        _timerCounter->COUNT32.CTRLA.reg = _ctrlA;
+    waitRegSync();
+
+    _isActive = true;
+
+    return true;
+}
+
+void TimerCounter::endCapture()
+{
+    if( !_capturing ) return;
+
+    end();
+    _capturing = false;
+
+    detachEventUser( EVSYS_ID_USER_TC0_EVU + _tcNum );
+    freeEventChannel( _captureChannel );
+    _captureChannel = -1;
+    detachInterruptEvent( _capturePin );
+}
+
+void TimerCounter::onCapture( TCCaptureCallback_t cb )
+{
+    _captureCallback = cb;
+}
+
+bool TimerCounter::readCapture( uint32_t *period, uint32_t *width )
+{
+    if( !_captureReady ) return false;
+
+    ATOMIC_OPERATION( {
+        *period = _capturePeriod;
+        *width = _captureWidth;
+        _captureReady = false;
+    } )
+
+    return true;
+}
+
+uint32_t TimerCounter::getCaptureErrors()
+{
+    return _captureErrors;
+}
+
+uint32_t TimerCounter::getTickFrequency()
+{
+    return _clkFreq / tcPrescalerDiv( ( _ctrlA & TC_CTRLA_PRESCALER_Msk ) >>
+                                      TC_CTRLA_PRESCALER_Pos );
+}
+
+void TimerCounter::captureService()
+{
+    uint8_t  flags;
+    uint32_t cc0, cc1;
+    uint8_t  endFlag =
+        _captureAction == tc_capture_ppw ? TC_INTFLAG_MC0 : TC_INTFLAG_MC1;
+
+    // The interrupt flags sit in the same place in every counter mode
+    flags = _timerCounter->COUNT16.INTFLAG.reg;
+
+    // A capture wasn't read before the next one
+    if( flags & TC_INTFLAG_ERR ) {
+        _timerCounter->COUNT16.INTFLAG.reg = TC_INTFLAG_ERR;
+        _captureErrors++;
+    }
+
+    // No edge for a whole count, the period in progress is too long
+    if( flags & TC_INTFLAG_OVF ) {
+        _timerCounter->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+        _captureOverflow = true;
+    }
+
+    if( flags & endFlag ) {
+        // Reading the captures clears their flags
+        if( _mode == tc_mode_16_bit ) {
+            cc0 = _timerCounter->COUNT16.CC[0].reg;
+            cc1 = _timerCounter->COUNT16.CC[1].reg;
+        }
+        else {
+            cc0 = _timerCounter->COUNT32.CC[0].reg;
+            cc1 = _timerCounter->COUNT32.CC[1].reg;
+        }
+
+        if( _captureOverflow ) {
+            _captureOverflow = false;
+            return;
+        }
+
+        _capturePeriod = _captureAction == tc_capture_ppw ? cc0 : cc1;
+        _captureWidth = _captureAction == tc_capture_ppw ? cc1 : cc0;
+        _captureReady = true;
+
+        if( _captureCallback != NULL )
+            _captureCallback( _capturePeriod, _captureWidth );
+    }
+}
+
+void TimerCounter::setDividerAndCC( const TCPlan_t &plan )
+{
+    _plan = plan;
+
+    _ctrlA |= TC_CTRLA_WAVEGEN_MFRQ; // Toggle mode
+    _ctrlA |= TC_CTRLA_PRESCALER( _plan.prescaler );
+    _ccVal = _plan.period - 1;
+}
+
+void TimerCounter::waitRegSync()
+{
+    if( _mode != tc_mode_32_bit || ( _tcNum % 2 ) == 0 ) {
+        while( _timerCounter->COUNT16.STATUS.bit.SYNCBUSY )
+            ;
+    }
 }
@@ -20,15 +20,35 @@
 #define TIMERCOUNTER_H_
 
 #include <stdint.h>
+#include <stddef.h>
 #include "sam.h"
 
+// GCLK1, the 32kHz clock that keeps running in standby
+#define TC_STANDBY_CLK_FREQ 32768ul
+
+// Largest compare value for each counter size
+#define CC_8_BIT_MAX 0xFF
+#define CC_16_BIT_MAX 0xFFFF
+#define CC_32_BIT_MAX 0xFFFFFFFF
+
+// Default waveform outputs, WO[0] toggles with begin( output = true ) and
+// WO[1] carries the PWM. TC0 and TC1 share their pins with the analog
+// comparator inputs. Any other pin with a timer function can be picked with
+// setOutputPin().
 #if defined( __SAMD20E18__ )
-#define TC0_OUTPIN 0 // TODO
-#define TC1_OUTPIN 0 // TODO
+#define TC0_OUTPIN 14
+#define TC1_OUTPIN 16
 #define TC2_OUTPIN 5
 #define TC3_OUTPIN 3
 #define TC4_OUTPIN 9
 #define TC5_OUTPIN 1
+
+#define TC0_PWMPIN 15
+#define TC1_PWMPIN 17
+#define TC2_PWMPIN 6
+#define TC3_PWMPIN 4
+#define TC4_PWMPIN 10
+#define TC5_PWMPIN 0
 #endif /* __SAMD20E18 */
 
 typedef enum
@@ -38,6 +58,189 @@ typedef enum
     tc_mode_32_bit
 } TCMode_t;
 
+// Event actions for input capture, both capture the period and the pulse
+// width. PPW restarts the count on the rising edge (period in CC0, width in
+// CC1), PWP the other way around.
+typedef enum
+{
+    tc_capture_ppw = TC_EVCTRL_EVACT_PPW_Val,
+    tc_capture_pwp = TC_EVCTRL_EVACT_PWP_Val
+} TCCapture_t;
+
+// Called from the timer interrupt with each period and pulse width in ticks
+typedef void ( *TCCaptureCallback_t )( uint32_t period, uint32_t width );
+
+// Furthest beginDualPWM() lets the frequency come out from the one asked
+// for, in ppm. The full 16 bit period only steps by the prescaler, past this
+// it drops to 8 bits and past it at 8 bits too it fails.
+#define TC_DUAL_PWM_MAX_ERROR 100000
+
+// Duty updates a second during a PWM fade, at most one per period
+#define TC_FADE_RATE 1000
+
+// Path a PWM fade takes between its two duty cycles
+typedef enum
+{
+    tc_fade_linear,
+    tc_fade_gamma, // Even steps in the brightness of an LED, gamma 2.2
+    tc_fade_exponential // Even ratios, as motors and audio levels like
+} TCFadeCurve_t;
+
+// Called from the timer interrupt once a fade has reached its end duty
+typedef void ( *TCFadeCallback_t )( uint8_t channel );
+
+// Fade in progress, positions are along the curve in Q16 with 8 more bits of
+// fraction kept for the step
+typedef struct
+{
+    int32_t       pos;
+    int32_t       delta;
+    uint32_t      stepsLeft;
+    uint16_t      to;
+    TCFadeCurve_t curve;
+    volatile bool active;
+} TCFade_t;
+
+// Prescaler and period for a timer toggling its output at a frequency, which
+// is the counter wrapping at twice that rate (MFRQ), or for the counter
+// wrapping at a rate
+typedef struct
+{
+    uint8_t  prescaler; // CTRLA PRESCALER field, DIV1 to DIV1024
+    uint32_t period;    // Counts per wrap, CC[0] is one less
+    uint32_t frequency; // Achieved, to the nearest Hz
+    int32_t  ppm;       // Error of the achieved frequency
+} TCPlan_t;
+
+// The planner below is constexpr so a constant frequency is planned at
+// compile time. It is written as single return functions (C++11) and tries
+// both periods either side of the ideal for every prescaler, keeping the
+// lowest error and on a tie the smaller prescaler. wraps is how many times
+// the counter wraps for each cycle of the frequency.
+constexpr uint32_t tcPrescalerDiv( uint8_t prescaler )
+{
+    return prescaler < 5 ? 1ul << prescaler : 16ul << ( 2 * ( prescaler - 4 ) );
+}
+
+constexpr int64_t tcErrorPpm( uint32_t clkFreq, uint32_t freq, uint64_t ticks )
+{
+    return ( ( (int64_t)clkFreq - (int64_t)ticks * freq ) * 1000000ll ) /
+           ( (int64_t)ticks * freq );
+}
+
+constexpr int32_t tcClampPpm( int64_t ppm )
+{
+    return ppm > INT32_MAX ? INT32_MAX
+                           : ( ppm < INT32_MIN ? INT32_MIN : (int32_t)ppm );
+}
+
+constexpr TCPlan_t tcPlanMake( uint32_t clkFreq, uint32_t freq, uint8_t wraps,
+                               uint8_t prescaler, uint64_t period )
+{
+    return {prescaler, (uint32_t)period,
+            ( uint32_t )(
+                ( 2ull * clkFreq +
+                  wraps * tcPrescalerDiv( prescaler ) * period ) /
+                ( 2 * wraps * tcPrescalerDiv( prescaler ) * period ) ),
+            tcClampPpm( tcErrorPpm( clkFreq, freq,
+                                    wraps * tcPrescalerDiv( prescaler ) *
+                                        period ) )};
+}
+
+constexpr uint64_t tcClampPeriod( uint64_t period, uint64_t maxPeriod )
+{
+    return period < 1 ? 1 : ( period > maxPeriod ? maxPeriod : period );
+}
+
+constexpr TCPlan_t tcPlanBetter( TCPlan_t a, TCPlan_t b )
+{
+    return ( b.ppm < 0 ? -(int64_t)b.ppm : b.ppm ) <
+                   ( a.ppm < 0 ? -(int64_t)a.ppm : a.ppm )
+               ? b
+               : a;
+}
+
+constexpr TCPlan_t tcPlanPrescaler( uint32_t clkFreq, uint32_t freq,
+                                    uint8_t wraps, uint64_t maxPeriod,
+                                    uint8_t prescaler )
+{
+    return tcPlanBetter(
+        tcPlanMake( clkFreq, freq, wraps, prescaler,
+                    tcClampPeriod( clkFreq / ( (uint64_t)wraps *
+                                               tcPrescalerDiv( prescaler ) *
+                                               freq ),
+                                   maxPeriod ) ),
+        tcPlanMake( clkFreq, freq, wraps, prescaler,
+                    tcClampPeriod( clkFreq / ( (uint64_t)wraps *
+                                               tcPrescalerDiv( prescaler ) *
+                                               freq ) +
+                                       1,
+                                   maxPeriod ) ) );
+}
+
+constexpr TCPlan_t tcPlanFrom( uint32_t clkFreq, uint32_t freq, uint8_t wraps,
+                               uint64_t maxPeriod, uint8_t prescaler )
+{
+    return prescaler == 7
+               ? tcPlanPrescaler( clkFreq, freq, wraps, maxPeriod, 7 )
+               : tcPlanBetter( tcPlanPrescaler( clkFreq, freq, wraps,
+                                                maxPeriod, prescaler ),
+                               tcPlanFrom( clkFreq, freq, wraps, maxPeriod,
+                                           prescaler + 1 ) );
+}
+
+// Plans a timer clocked at clkFreq toggling at freq with CC[0] up to maxCC
+constexpr TCPlan_t planTCFrequency( uint32_t clkFreq, uint32_t freq,
+                                    uint32_t maxCC )
+{
+    return freq == 0 ? TCPlan_t{0, 0, 0, 0}
+                     : tcPlanFrom( clkFreq, freq, 2, (uint64_t)maxCC + 1, 0 );
+}
+
+// Plans a timer clocked at clkFreq wrapping at rate with CC[0] up to maxCC,
+// for pacing and ticks where an odd rate mustn't be halved first
+constexpr TCPlan_t planTCWrap( uint32_t clkFreq, uint32_t rate, uint32_t maxCC )
+{
+    return rate == 0 ? TCPlan_t{0, 0, 0, 0}
+                     : tcPlanFrom( clkFreq, rate, 1, (uint64_t)maxCC + 1, 0 );
+}
+
+// Register view for each counter size, so code written for one size picks
+// its COUNT and CC registers at compile time. CTRLA, STATUS and the interrupt
+// registers sit in the same place in every view.
+template <TCMode_t MODE>
+struct TCView;
+
+template <>
+struct TCView<tc_mode_8_bit>
+{
+    static const uint32_t max = 0xFF;
+    static TcCount8 &regs( Tc *tc )
+    {
+        return tc->COUNT8;
+    }
+};
+
+template <>
+struct TCView<tc_mode_16_bit>
+{
+    static const uint32_t max = 0xFFFF;
+    static TcCount16 &regs( Tc *tc )
+    {
+        return tc->COUNT16;
+    }
+};
+
+template <>
+struct TCView<tc_mode_32_bit>
+{
+    static const uint32_t max = 0xFFFFFFFF;
+    static TcCount32 &regs( Tc *tc )
+    {
+        return tc->COUNT32;
+    }
+};
+
 class TimerCounter
 {
   public:
@@ -45,15 +248,39 @@ class TimerCounter
     void     registerISR( void ( *isr )() );
     void     deregisterISR();
     void     beginPWM( uint32_t frequency, uint8_t dutyCycle );
-    void     begin( uint32_t frequency, bool output = false,
-                    TCMode_t mode = tc_mode_16_bit, bool useInterrupts = false );
+
+    // With runInStandby the counter is clocked from GCLK1 and keeps going in
+    // deep sleep, so its interrupts can wake the CPU. Plans passed in have
+    // to be made for TC_STANDBY_CLK_FREQ then. TC0/TC1, TC2/TC3 and TC4/TC5
+    // share a clock, both timers of a pair run from whichever was started
+    // last.
+    void begin( uint32_t frequency, bool output = false,
+                TCMode_t mode = tc_mode_16_bit, bool useInterrupts = false,
+                bool runInStandby = false );
+    void begin( const TCPlan_t &plan, bool output = false,
+                TCMode_t mode = tc_mode_16_bit, bool useInterrupts = false,
+                bool runInStandby = false );
+
+    // As begin() but the counter wraps at rate rather than toggling at it, so
+    // an odd pacing or tick rate plans as closely as an even one
+    void beginWrap( uint32_t rate, TCMode_t mode = tc_mode_16_bit,
+                    bool useInterrupts = false, bool runInStandby = false );
     void     reset();
-    void     end();
+    void     end(); // Leaves a clock shared with the other TC of the pair on
     void     resume();
     void     pause();
     void     IrqHandler();
     uint32_t getCount();
     void     setCount( uint32_t count );
+
+    // Counts per wrap, changed on the fly. The count must not already be past
+    // the new period or it runs on to the top of the counter first.
+    uint32_t getPeriod()
+    {
+        return _ccVal + 1;
+    }
+    void setPeriod( uint32_t counts );
+    bool isMatchPending(); // The wrap interrupt hasn't been serviced yet
     bool     isActive()
     {
         return _isActive;
@@ -64,11 +291,84 @@ class TimerCounter
     }
     void setPWMDutyCycle( uint8_t dutyCycle );
 
-  private:
+    // PWM on both WO[0] and WO[1], duty cycles are 16 bit fractions of the
+    // period. Both channels share the counter's top, so the counter runs the
+    // full 16 bits when a prescaler brings the clock / 65536 within
+    // TC_DUAL_PWM_MAX_ERROR and 8 bits (with PER as the top) otherwise,
+    // failing if that's still too far off. getFrequency() is the PWM
+    // frequency after this. beginPWM() drives WO[1] only but keeps any
+    // frequency, with CC[0] as the top.
+    bool beginDualPWM( uint32_t frequency, uint16_t duty0, uint16_t duty1 );
+
+    // New duty cycles are written from the channel's compare interrupt, once
+    // its output has gone low for the period, so no period is cut short or
+    // stretched
+    void     setPWMDuty( uint8_t channel, uint16_t duty );
+    uint32_t getPWMSteps(); // Counts per period
+    uint8_t  getPWMResolution(); // Bits
+
+    // Walks a channel's duty from one value to another over ms along the
+    // curve, stepped from the overflow interrupt up to TC_FADE_RATE times a
+    // second. setPWMDuty() or stopFade() on the channel stops it where it
+    // is. Exponential fades take 0 as 1 count except at the very end.
+    bool fadePWM( uint8_t channel, uint16_t from, uint16_t to, uint32_t ms,
+                  TCFadeCurve_t curve = tc_fade_linear,
+                  TCFadeCallback_t cb = NULL );
+    void stopFade( uint8_t channel );
+    bool isFading( uint8_t channel );
+
+    // Moves WO[0] or WO[1], whichever the pin carries, to another pin. The
+    // pin needs a timer function in gArduinoPins on a port pin wired to this
+    // TC. Can't be changed while the timer is running.
+    bool   setOutputPin( int32_t pin );
+    int8_t getPinChannel( int32_t pin ); // WO index, -1 if not this TC's
+    int8_t getOutputPin( uint8_t channel );
+
+    // Rate the counter wraps at, twice the frequency passed to begin() since
+    // the output toggles on every wrap, or the rate passed to beginWrap()
+    uint32_t getOverflowFrequency();
+
+    // Frequency begin() (or beginDualPWM()) actually achieved and its error
+    // in ppm
+    uint32_t getFrequency()
+    {
+        return _plan.frequency;
+    }
+    int32_t getFrequencyError()
+    {
+        return _plan.ppm;
+    }
+
+    // Overflow event output, route it with the events helpers using the
+    // generator from getOverflowEventGenerator()
+    void     enableOverflowEvent( bool enable );
+    uint32_t getOverflowEventGenerator();
+
+    // Input capture. The pin's level goes through the EIC and the event
+    // system straight into the capture channels, so each period and pulse
+    // width is measured in timer ticks with no CPU involvement until the
+    // interrupt that collects them. invert measures the low time instead.
+    // Periods longer than the counter range are dropped.
+    bool beginCapture( uint32_t pin, TCCapture_t action = tc_capture_ppw,
+                       TCMode_t mode = tc_mode_32_bit,
+                       uint8_t  prescaler = TC_CTRLA_PRESCALER_DIV1_Val,
+                       bool     invert = false );
+    void endCapture();
+    void onCapture( TCCaptureCallback_t cb );
+
+    // Returns false when nothing has been captured since the last call
+    bool     readCapture( uint32_t *period, uint32_t *width );
+    uint32_t getCaptureErrors(); // Captures overwritten before being read
+    uint32_t getTickFrequency();
+
+  protected:
     int8_t   _tcNum;
+    int8_t   _outPin;
+    int8_t   _pwmPin;
     bool     _isPaused;
     bool     _isActive;
-    uint32_t _maxFreq;
+    uint32_t _clkFreq;
+    TCPlan_t _plan;
     uint32_t _ccVal;
     uint32_t _ctrlA;
     Tc *     _timerCounter;
@@ -77,8 +377,100 @@ class TimerCounter
     uint32_t _clkID;
     uint32_t _irqn;
     void ( *isrPtr )();
-    void setDividerAndCC( uint32_t freq, uint32_t maxCC );
+
+    // Input capture
+    bool                         _capturing;
+    uint32_t                     _capturePin;
+    int8_t                       _captureChannel;
+    TCCapture_t                  _captureAction;
+    volatile bool                _captureReady;
+    volatile bool                _captureOverflow;
+    volatile uint32_t            _capturePeriod;
+    volatile uint32_t            _captureWidth;
+    volatile uint32_t            _captureErrors;
+    volatile TCCaptureCallback_t _captureCallback;
+
+    // The odd TC of a 32 bit pair needs its bus clock as well
+    uint32_t apbcMask()
+    {
+        return _mode == tc_mode_32_bit ? _APBCMask | ( _APBCMask << 1 )
+                                       : _APBCMask;
+    }
+
+    // The other TC sharing this one's generic clock
+    uint32_t pairAPBCMask()
+    {
+        return ( _tcNum % 2 ) == 0 ? _APBCMask << 1 : _APBCMask >> 1;
+    }
+
+    // PWM
+    uint8_t           _pwmOutputs; // 0 off, 1 WO[1], 2 WO[0] and WO[1]
+    uint32_t          _pwmTop;
+    uint32_t          _pwmCC[2];
+    volatile uint32_t _pwmNext[2];
+
+    // PWM fades, the overflow interrupt steps every _fadeDiv periods
+    TCFade_t                  _fade[2];
+    volatile TCFadeCallback_t _fadeCallback[2];
+    uint32_t                  _fadeDiv;
+    uint32_t                  _fadeCount;
+
+    void setDividerAndCC( const TCPlan_t &plan );
+    void captureService();
+    void pwmService();
+    void fadeService();
+    void queuePWMDuty( uint8_t channel, uint16_t duty );
+    void writePWMCC( uint8_t channel, uint32_t cc );
     void waitRegSync();
 };
 
+// TimerCounter fixed to one counter size, count and period accesses resolve
+// their register at compile time. The interrupt goes through the
+// TimerCounter handler, which doesn't depend on the size.
+template <TCMode_t MODE>
+class TimerCounterT : public TimerCounter
+{
+  public:
+    TimerCounterT( Tc *timerCounter ) : TimerCounter( timerCounter )
+    {
+    }
+
+    void begin( uint32_t frequency, bool output = false,
+                bool useInterrupts = false, bool runInStandby = false )
+    {
+        TimerCounter::begin( frequency, output, MODE, useInterrupts,
+                             runInStandby );
+    }
+    void begin( const TCPlan_t &plan, bool output = false,
+                bool useInterrupts = false, bool runInStandby = false )
+    {
+        TimerCounter::begin( plan, output, MODE, useInterrupts, runInStandby );
+    }
+
+    uint32_t getCount()
+    {
+        return TCView<MODE>::regs( _timerCounter ).COUNT.reg;
+    }
+    void setCount( uint32_t count )
+    {
+        TCView<MODE>::regs( _timerCounter ).COUNT.reg =
+            count & TCView<MODE>::max;
+        syncRegs();
+    }
+    void setPeriod( uint32_t counts )
+    {
+        _ccVal = counts - 1;
+        TCView<MODE>::regs( _timerCounter ).CC[0].reg =
+            _ccVal & TCView<MODE>::max;
+        syncRegs();
+    }
+
+  private:
+    void syncRegs()
+    {
+        while( TCView<MODE>::regs( _timerCounter ).STATUS.bit.SYNCBUSY )
+            ;
+    }
+};
+
 #endif /* TIMERCOUNTER_H_ */
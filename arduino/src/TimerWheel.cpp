@@ -0,0 +1,304 @@
+/*
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+#include "TimerWheel.h"
+#include "atomic.h"
+
+#define TIMER_WHEEL_MASK ( TIMER_WHEEL_SLOTS - 1 )
+
+// Periods are kept to 16 bits, so a full turn has to fit in the counter
+#define TIMER_WHEEL_MAX_COUNTS 0x10000ul
+
+// Running wheels, the timer interrupt only takes a plain function so each
+// entry gets its own
+static TimerWheel *_wheels[TIMER_WHEEL_MAX] = {NULL, NULL, NULL, NULL};
+
+template <int N>
+static void wheelISR()
+{
+    if( _wheels[N] != NULL ) _wheels[N]->onService();
+}
+
+static void ( *const _wheelISRs[TIMER_WHEEL_MAX] )() = {
+    wheelISR<0>, wheelISR<1>, wheelISR<2>, wheelISR<3>};
+
+TimerWheel::TimerWheel( TimerCounter *timer )
+{
+    _timer = timer;
+    _num = -1;
+    _idle = true;
+    _inService = false;
+    _tickHz = 0;
+    _tickCounts = 1;
+    _marginCounts = 0;
+    _maxStep = TIMER_WHEEL_SLOTS;
+    _now = 0;
+    _step = 0;
+    _armed = 0;
+    _cursor = NULL;
+
+    for( uint32_t i = 0; i < TIMER_WHEEL_SLOTS; i++ ) _slots[i] = NULL;
+    for( uint32_t i = 0; i < TIMER_WHEEL_SLOTS / 32; i++ ) _occupied[i] = 0;
+}
+
+bool TimerWheel::begin( uint32_t tickHz, bool runInStandby )
+{
+    TCPlan_t plan;
+    uint32_t clkFreq, div;
+    uint8_t  n;
+
+    if( _timer == NULL || _num != -1 || tickHz == 0 ) return false;
+
+    for( n = 0; n < TIMER_WHEEL_MAX; n++ )
+        if( _wheels[n] == NULL ) break;
+    if( n == TIMER_WHEEL_MAX ) return false;
+
+    // A tick is one wrap of the counter, planned so a whole turn of the wheel
+    // still fits in 16 bits
+    clkFreq = runInStandby ? TC_STANDBY_CLK_FREQ : SystemCoreClock;
+    plan = planTCWrap( clkFreq, tickHz,
+                       TIMER_WHEEL_MAX_COUNTS / TIMER_WHEEL_SLOTS - 1 );
+    if( plan.frequency == 0 ) return false;
+
+    _num = n;
+    _wheels[n] = this;
+    div = tcPrescalerDiv( plan.prescaler );
+    _tickCounts = plan.period;
+    _tickHz = clkFreq / ( div * plan.period );
+    _marginCounts = (uint64_t)TIMER_WHEEL_MARGIN_CYCLES * clkFreq /
+                        ( (uint64_t)SystemCoreClock * div ) +
+                    1;
+    if( runInStandby ) _marginCounts += TIMER_WHEEL_MARGIN_SYNC;
+    _maxStep = TIMER_WHEEL_MAX_COUNTS / _tickCounts;
+    if( _maxStep > TIMER_WHEEL_SLOTS ) _maxStep = TIMER_WHEEL_SLOTS;
+
+    _timer->registerISR( _wheelISRs[n] );
+    _timer->begin( plan, false, tc_mode_16_bit, true, runInStandby );
+
+    // Nothing is armed yet
+    ATOMIC_OPERATION( {
+        _timer->pause();
+        _timer->setCount( 0 );
+        _idle = true;
+        _step = 0;
+        if( _armed != 0 ) schedule( _now + nextStep() );
+    } )
+
+    return true;
+}
+
+void TimerWheel::end()
+{
+    if( _num == -1 ) return;
+
+    _timer->end();
+    _timer->deregisterISR();
+    _wheels[_num] = NULL;
+    _num = -1;
+    _idle = true;
+
+    for( uint32_t i = 0; i < TIMER_WHEEL_SLOTS; i++ ) {
+        while( _slots[i] != NULL ) unlink( _slots[i] );
+    }
+}
+
+bool TimerWheel::start( SoftTimer_t *timer, SoftTimerCallback_t cb,
+                        uint32_t delay, uint32_t period )
+{
+    if( timer == NULL || cb == NULL ) return false;
+    if( delay == 0 ) delay = 1;
+
+    ATOMIC_OPERATION( {
+        if( timer->pprev != NULL ) unlink( timer );
+
+        timer->callback = cb;
+        timer->period = period;
+        timer->expiry = now() + delay;
+        link( timer );
+
+        // The interrupt works out its own next wake-up
+        if( _num != -1 && !_inService ) schedule( timer->expiry );
+    } )
+
+    return true;
+}
+
+bool TimerWheel::cancel( SoftTimer_t *timer )
+{
+    bool wasArmed = false;
+
+    // The counter is left alone, at worst it wakes up to an empty slot
+    ATOMIC_OPERATION( {
+        if( timer->pprev != NULL ) {
+            unlink( timer );
+            wasArmed = true;
+        }
+    } )
+
+    return wasArmed;
+}
+
+uint32_t TimerWheel::now()
+{
+    uint32_t ticks, count;
+
+    ATOMIC_OPERATION( {
+        ticks = _now;
+
+        // Add the part of the current step that has gone by, a wrap that
+        // hasn't been serviced yet means the whole step has
+        if( _num != -1 && !_idle && !_inService ) {
+            count = _timer->getCount();
+            if( _timer->isMatchPending() ) {
+                ticks += _step;
+                count = _timer->getCount();
+            }
+            ticks += count / _tickCounts;
+        }
+    } )
+
+    return ticks;
+}
+
+void TimerWheel::advance( uint32_t ticks )
+{
+    uint32_t slot;
+
+    while( ticks-- ) {
+        _now++;
+        slot = _now & TIMER_WHEEL_MASK;
+        if( _occupied[slot >> 5] & ( 1ul << ( slot & 31 ) ) ) runSlot( _now );
+    }
+}
+
+void TimerWheel::onService()
+{
+    _inService = true;
+    advance( _step );
+    _inService = false;
+
+    if( _armed == 0 ) {
+        _timer->pause();
+        _idle = true;
+    }
+    else
+        program( nextStep() );
+}
+
+void TimerWheel::link( SoftTimer_t *timer )
+{
+    uint32_t slot = timer->expiry & TIMER_WHEEL_MASK;
+
+    // New timers go in at the head, behind the cursor of a slot being run
+    timer->next = _slots[slot];
+    if( timer->next != NULL ) timer->next->pprev = &timer->next;
+    timer->pprev = &_slots[slot];
+    _slots[slot] = timer;
+
+    _occupied[slot >> 5] |= 1ul << ( slot & 31 );
+    _armed++;
+}
+
+void TimerWheel::unlink( SoftTimer_t *timer )
+{
+    uint32_t slot = timer->expiry & TIMER_WHEEL_MASK;
+
+    if( timer == _cursor ) _cursor = timer->next;
+
+    *timer->pprev = timer->next;
+    if( timer->next != NULL ) timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+
+    if( _slots[slot] == NULL )
+        _occupied[slot >> 5] &= ~( 1ul << ( slot & 31 ) );
+    _armed--;
+}
+
+void TimerWheel::runSlot( uint32_t tick )
+{
+    SoftTimer_t *timer;
+
+    // Callbacks can start and cancel timers, unlink() keeps the cursor valid
+    _cursor = _slots[tick & TIMER_WHEEL_MASK];
+    while( _cursor != NULL ) {
+        timer = _cursor;
+        _cursor = timer->next;
+
+        // Not due until a later turn
+        if( timer->expiry != tick ) continue;
+
+        unlink( timer );
+        if( timer->period != 0 ) {
+            timer->expiry += timer->period;
+            link( timer );
+        }
+
+        timer->callback( timer );
+    }
+}
+
+// Ticks to the next occupied slot, searching the bitmap a word at a time
+uint32_t TimerWheel::nextStep()
+{
+    uint32_t slot, bits, step;
+
+    for( step = 1; step < _maxStep; ) {
+        slot = ( _now + step ) & TIMER_WHEEL_MASK;
+        bits = _occupied[slot >> 5] >> ( slot & 31 );
+        if( bits != 0 ) {
+            step += __builtin_ctz( bits );
+            break;
+        }
+        step += 32 - ( slot & 31 );
+    }
+
+    return step < _maxStep ? step : _maxStep;
+}
+
+// Brings the wake-up forward for a timer due before it
+void TimerWheel::schedule( uint32_t expiry )
+{
+    uint32_t step = expiry - _now;
+
+    if( step > _maxStep ) step = _maxStep;
+
+    if( _idle ) {
+        _idle = false;
+        _step = step;
+        _timer->setCount( 0 );
+        _timer->setPeriod( step * _tickCounts );
+        _timer->resume();
+        return;
+    }
+
+    // Already waking first, or the interrupt is about to look at the wheel
+    if( step >= _step || _timer->isMatchPending() ) return;
+    program( step );
+}
+
+// Sets the next wake-up step ticks after the last one, pushed out as far as
+// needed for the counter not to have got there already
+void TimerWheel::program( uint32_t step )
+{
+    uint32_t count = _timer->getCount() + _marginCounts;
+
+    while( step * _tickCounts <= count && step < _maxStep ) step++;
+
+    _step = step;
+    _timer->setPeriod( step * _tickCounts );
+}
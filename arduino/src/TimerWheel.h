@@ -0,0 +1,122 @@
+/*
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "TimerCounter.h"
+
+// Slots in the wheel, a power of two and a multiple of 32. Timers further out
+// than one turn share slots with nearer ones and are skipped until their turn.
+#define TIMER_WHEEL_SLOTS 64
+#define TIMER_WHEEL_MAX 4 // Wheels running at once, one per TimerCounter
+
+#define TIMER_WHEEL_TICK_HZ 1000
+
+// CPU cycles allowed between reading the count and moving the period, the
+// period is never put closer than this to the count. Slow counters get a
+// couple more counts as their reads and writes lag behind.
+#define TIMER_WHEEL_MARGIN_CYCLES 256
+#define TIMER_WHEEL_MARGIN_SYNC 2
+
+typedef struct SoftTimer_s SoftTimer_t;
+
+// Called from the timer interrupt when a timer expires. A periodic timer has
+// already been re-armed, so the callback can cancel or restart it.
+typedef void ( *SoftTimerCallback_t )( SoftTimer_t *timer );
+
+// Owned by the caller and linked into the wheel while armed. Must start out
+// zeroed, as globals and statics are.
+struct SoftTimer_s
+{
+    SoftTimer_t *       next;
+    SoftTimer_t **      pprev; // NULL while not armed
+    uint32_t            expiry;
+    uint32_t            period; // 0 for one shot
+    SoftTimerCallback_t callback;
+};
+
+// Any number of one shot and periodic timers on one TimerCounter. Timers hash
+// into slots by their expiry tick, so starting and cancelling are O(1) and
+// each expiry costs O(1) plus a visit for every turn a timer spends waiting.
+// The counter is set up to wake at the next occupied slot rather than every
+// tick, and is paused while nothing is armed. Wheel time stands still while
+// paused.
+class TimerWheel
+{
+  public:
+    TimerWheel( TimerCounter *timer );
+
+    // The counter runs in 16 bit mode so any of the four can be used. With
+    // runInStandby it is clocked at 32kHz and timers wake the CPU from deep
+    // sleep, ticks are then whole counts of that clock.
+    bool begin( uint32_t tickHz = TIMER_WHEEL_TICK_HZ,
+                bool     runInStandby = false );
+    void end(); // Cancels every timer
+
+    // Restarts the timer if it is already armed. Delays and periods are in
+    // ticks, a delay of 0 is taken as 1.
+    bool start( SoftTimer_t *timer, SoftTimerCallback_t cb, uint32_t delay,
+                uint32_t period = 0 );
+    bool cancel( SoftTimer_t *timer ); // Returns false if it wasn't armed
+
+    static bool isArmed( SoftTimer_t *timer )
+    {
+        return timer->pprev != NULL;
+    }
+    uint32_t getArmedCount()
+    {
+        return _armed;
+    }
+    uint32_t getTickFrequency()
+    {
+        return _tickHz;
+    }
+    uint32_t now();
+
+    // Moves the wheel on and runs whatever expires. The timer interrupt does
+    // this once begin() has been called, without a timer it can be stepped
+    // by hand.
+    void advance( uint32_t ticks );
+
+    void onService();
+
+  private:
+    TimerCounter *    _timer;
+    int8_t            _num;
+    bool              _idle;
+    bool              _inService;
+    uint32_t          _tickHz;
+    uint32_t          _tickCounts;
+    uint32_t          _marginCounts;
+    uint32_t          _maxStep;
+    volatile uint32_t _now;
+    volatile uint32_t _step;
+    volatile uint32_t _armed;
+    SoftTimer_t *     _cursor;
+    SoftTimer_t *     _slots[TIMER_WHEEL_SLOTS];
+    uint32_t          _occupied[TIMER_WHEEL_SLOTS / 32];
+
+    void     link( SoftTimer_t *timer );
+    void     unlink( SoftTimer_t *timer );
+    void     runSlot( uint32_t tick );
+    uint32_t nextStep();
+    void     schedule( uint32_t expiry );
+    void     program( uint32_t step );
+};
+
+#endif /* TIMERWHEEL_H_ */
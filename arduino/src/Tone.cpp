@@ -17,62 +17,146 @@
 */
 
 #include "Tone.h"
+#include "RTC.h"
+#include "atomic.h"
 
-uint64_t _durationCounts;
-uint64_t _counter;
-uint8_t  _channel;
+#define TONE_FOREVER UINT64_MAX
 
-void toneISR()
+typedef struct
 {
-    if( ++_counter > _durationCounts ) {
-        switch( _channel ) {
-            case 0: Timer.end(); break;
-            case 1: Timer1.end(); break;
-            case 2: Timer2.end(); break;
-            case 3: Timer3.end(); break;
+    bool              playing;
+    uint64_t          end; // RTC step the current note stops at
+    const ToneNote_t *notes; // Still to come
+    uint16_t          count;
+    ToneCallback_t    callback;
+} ToneChannel_t;
+
+static TimerCounter *const _toneTimers[TONE_CHANNELS] = {
+    &Timer, &Timer1, &Timer2, &Timer3, &Timer4, &Timer5};
+static ToneChannel_t _tones[TONE_CHANNELS];
+static RTCAlarm_t    _toneAlarm;
+
+static void toneAlarm( RTCAlarm_t *alarm );
+
+// Starts a note timed from start, a rest leaves the pin floating
+static void startNote( uint8_t channel, uint32_t frequency, uint32_t durationMs,
+                       uint64_t start )
+{
+    TimerCounter *timer = _toneTimers[channel];
+
+    timer->end();
+    if( frequency != 0 ) timer->begin( frequency, true, tc_mode_16_bit );
+
+    _tones[channel].end =
+        durationMs == 0
+            ? TONE_FOREVER
+            : start + RTC_EXACT_MILLIS_TO_STEPS( (uint64_t)durationMs );
+}
+
+// Alarm for whichever channel stops first
+static void scheduleTones()
+{
+    uint64_t next = TONE_FOREVER;
+
+    for( uint8_t ch = 0; ch < TONE_CHANNELS; ch++ ) {
+        if( _tones[ch].playing && _tones[ch].end < next )
+            next = _tones[ch].end;
+    }
+
+    if( next == TONE_FOREVER )
+        cancelRTCAlarm( &_toneAlarm );
+    else
+        startRTCAlarm( &_toneAlarm, next, toneAlarm, 0 );
+}
+
+static void toneAlarm( RTCAlarm_t *alarm )
+{
+    ToneChannel_t *tone;
+
+    // Channels due at the same step go together, others get their own alarm
+    for( uint8_t ch = 0; ch < TONE_CHANNELS; ch++ ) {
+        tone = &_tones[ch];
+        if( !tone->playing || tone->end > alarm->steps ) continue;
+
+        if( tone->count != 0 ) {
+            startNote( ch, tone->notes->frequency, tone->notes->durationMs,
+                       tone->end );
+            tone->notes++;
+            tone->count--;
+            continue;
         }
+
+        _toneTimers[ch]->end();
+        tone->playing = false;
+        if( tone->callback != NULL ) tone->callback( ch );
     }
+
+    scheduleTones();
+}
+
+// Plays one note now and the rest from the alarm
+static bool startTones( uint8_t channel, uint32_t frequency,
+                        uint32_t durationMs, const ToneNote_t *notes,
+                        uint16_t count, ToneCallback_t cb )
+{
+    TimerCounter *timer;
+    uint64_t      start;
+
+    if( channel >= TONE_CHANNELS ) return false;
+
+    // Nowhere to play it
+    timer = _toneTimers[channel];
+    if( timer->getPinChannel( timer->getOutputPin( 0 ) ) != 0 ) return false;
+
+    start = stepsRTC();
+    ATOMIC_OPERATION( {
+        _tones[channel].notes = notes;
+        _tones[channel].count = count;
+        _tones[channel].callback = cb;
+        _tones[channel].playing = true;
+        startNote( channel, frequency, durationMs, start );
+        scheduleTones();
+    } )
+
+    return true;
 }
 
 bool tone( uint8_t channel, uint32_t frequency, uint32_t durationSeconds )
 {
-    bool rtn = false;
-    _durationCounts = frequency * durationSeconds;
-    if( _durationCounts > 0 ) {
-
-        _counter = 0;
-        _channel = channel;
-
-        switch( channel ) {
-            case 0:
-                Timer.end();
-                Timer.deregisterISR();
-                Timer.registerISR( toneISR );
-                Timer.begin( frequency, true, tc_mode_16_bit, true );
-                rtn = true;
-                break;
-            case 1:
-                Timer1.end();
-                Timer1.deregisterISR();
-                Timer1.registerISR( toneISR );
-                Timer1.begin( frequency, true, tc_mode_16_bit, true );
-                rtn = true;
-                break;
-            case 2:
-                Timer2.end();
-                Timer2.deregisterISR();
-                Timer2.registerISR( toneISR );
-                Timer2.begin( frequency, true, tc_mode_16_bit, true );
-                rtn = true;
-                break;
-            case 3:
-                Timer3.end();
-                Timer3.deregisterISR();
-                Timer3.registerISR( toneISR );
-                Timer3.begin( frequency, true, tc_mode_16_bit, true );
-                rtn = true;
-                break;
+    if( frequency == 0 || durationSeconds == 0 ) return false;
+    return startTones( channel, frequency, durationSeconds * 1000, NULL, 0,
+                       NULL );
+}
+
+bool toneMillis( uint8_t channel, uint32_t frequency, uint32_t durationMs,
+                 ToneCallback_t cb )
+{
+    if( frequency == 0 ) return false;
+    return startTones( channel, frequency, durationMs, NULL, 0, cb );
+}
+
+bool playTones( uint8_t channel, const ToneNote_t *notes, uint16_t count,
+                ToneCallback_t cb )
+{
+    if( notes == NULL || count == 0 ) return false;
+    return startTones( channel, notes[0].frequency, notes[0].durationMs,
+                       &notes[1], count - 1, cb );
+}
+
+void noTone( uint8_t channel )
+{
+    if( channel >= TONE_CHANNELS ) return;
+
+    ATOMIC_OPERATION( {
+        if( _tones[channel].playing ) {
+            _tones[channel].playing = false;
+            _toneTimers[channel]->end();
+            scheduleTones();
         }
-    }
-    return rtn;
+    } )
+}
+
+bool isTonePlaying( uint8_t channel )
+{
+    return channel < TONE_CHANNELS && _tones[channel].playing;
 }
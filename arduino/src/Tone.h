@@ -22,6 +22,38 @@
 #include "TimerCounter.h"
 #include "delay.h"
 
+// One per TimerCounter, each plays on its timer's WO[0] pin: channels 0 to
+// 5 are Timer to Timer5, which are TC2, TC3, TC4, TC5, TC0 and TC1. TC5's
+// default pin has no timer function on this variant, so channel 3 can only
+// play once Timer3 has been given one with setOutputPin().
+#define TONE_CHANNELS 6
+
+// Step in a sequence, a frequency of 0 is a rest and a duration of 0 holds
+// the note until noTone()
+typedef struct
+{
+    uint16_t frequency;
+    uint16_t durationMs;
+} ToneNote_t;
+
+// Called from the RTC interrupt once a tone or sequence has finished
+typedef void ( *ToneCallback_t )( uint8_t channel );
+
+// Square waves from the channel's timer output. Channels play independently
+// and their durations are timed by an RTC alarm, so the timers themselves
+// raise no interrupts.
 bool tone( uint8_t channel, uint32_t frequency, uint32_t durationSeconds );
 
+// A duration of 0 plays until noTone()
+bool toneMillis( uint8_t channel, uint32_t frequency, uint32_t durationMs,
+                 ToneCallback_t cb = NULL );
+
+// Plays the notes back to back from the RTC interrupt, each one timed from
+// the end of the last so the sequence doesn't drift. The notes must stay
+// valid until it has finished.
+bool playTones( uint8_t channel, const ToneNote_t *notes, uint16_t count,
+                ToneCallback_t cb = NULL );
+void noTone( uint8_t channel );
+bool isTonePlaying( uint8_t channel );
+
 #endif /* TONE_H_ */
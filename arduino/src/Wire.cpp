@@ -0,0 +1,621 @@
+/*
+ * TWI/I2C library for Arduino Zero
+ * Copyright (c) 2015 Arduino LLC. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "Wire.h"
+
+#define TWI_CLOCK 100000
+
+// Half of the SCL period used while clearing the bus, 100kHz keeps even
+// standard mode slaves happy
+#define WIRE_RECOVERY_HALF_PERIOD_MICROS 5
+
+// Transaction phases, used to tell an address NACK from a data NACK
+#define WIRE_PHASE_IDLE 0
+#define WIRE_PHASE_ADDR_WRITE 1
+#define WIRE_PHASE_WRITE 2
+#define WIRE_PHASE_ADDR_READ 3
+#define WIRE_PHASE_READ 4
+
+TwoWire::TwoWire( SERCOM *s, uint8_t pinSDA, uint8_t pinSCL )
+{
+    _sercom = s;
+    _uc_pinSDA = pinSDA;
+    _uc_pinSCL = pinSCL;
+    _clock = TWI_CLOCK;
+    _riseTime = WIRE_RISE_TIME_NANOSECONDS;
+    _initialized = false;
+    _transmissionBegun = false;
+
+    _timeoutMicros = WIRE_TIMEOUT_MICROS;
+    _resetOnTimeout = true;
+    _timeoutFlag = false;
+
+    _txLength = 0;
+    _txAddress = 0;
+    _rxIndex = 0;
+    _rxLength = 0;
+
+    _busy = false;
+    _status = wire_success;
+    _phase = WIRE_PHASE_IDLE;
+    _callback = NULL;
+
+    _slaveMode = false;
+    _regMap = NULL;
+    _regWriteMask = NULL;
+    _regLen = 0;
+    _regAutoInc = true;
+    _regPtr = 0;
+    _regExpectPtr = false;
+    _regSentFirst = false;
+    _regChanged = false;
+    _regChangeCallback = NULL;
+}
+
+void TwoWire::begin()
+{
+    _sercom->initMasterWIRE( _clock, _riseTime );
+    _sercom->enableWIRE();
+
+    pinMode( _uc_pinSDA, gArduinoPins[_uc_pinSDA].i2c );
+    pinMode( _uc_pinSCL, gArduinoPins[_uc_pinSCL].i2c );
+
+    _busy = false;
+    _slaveMode = false;
+    _initialized = true;
+}
+
+void TwoWire::begin( uint8_t address, bool enableGeneralCall )
+{
+    _sercom->initSlaveWIRE( address, enableGeneralCall );
+    _sercom->enableWIRE();
+
+    pinMode( _uc_pinSDA, gArduinoPins[_uc_pinSDA].i2c );
+    pinMode( _uc_pinSCL, gArduinoPins[_uc_pinSCL].i2c );
+
+    _busy = false;
+    _slaveMode = true;
+    _regPtr = 0;
+    _regExpectPtr = false;
+    _regChanged = false;
+    _initialized = true;
+}
+
+void TwoWire::end()
+{
+    if( _initialized ) {
+        _sercom->disableInterruptsMasterWIRE();
+        _sercom->endWire();
+        _initialized = false;
+    }
+
+    _busy = false;
+    pinMode( _uc_pinSDA, TRI_STATE );
+    pinMode( _uc_pinSCL, TRI_STATE );
+}
+
+void TwoWire::setClock( uint32_t baudrate, uint32_t riseTimeNs )
+{
+    _clock = baudrate;
+    _riseTime = riseTimeNs;
+    if( _initialized && !_slaveMode ) {
+        _sercom->disableWIRE();
+        _sercom->initMasterWIRE( _clock, _riseTime );
+        _sercom->enableWIRE();
+    }
+}
+
+// The SCL frequency actually produced, which is the closest the BAUD register
+// can get to the requested clock without going over
+uint32_t TwoWire::getClock()
+{
+    uint8_t baud, baudLow;
+
+    if( _initialized && !_slaveMode ) return _sercom->getBaudrateWIRE();
+    return SERCOM::calculateBaudrateWIRE( _clock, _riseTime, &baud, &baudLow );
+}
+
+void TwoWire::setWireTimeout( uint32_t timeoutMicros, bool resetWithTimeout )
+{
+    _timeoutMicros = timeoutMicros;
+    _resetOnTimeout = resetWithTimeout;
+    _timeoutFlag = false;
+}
+
+bool TwoWire::getWireTimeoutFlag()
+{
+    return _timeoutFlag;
+}
+
+void TwoWire::clearWireTimeoutFlag()
+{
+    _timeoutFlag = false;
+}
+
+// Bus clear from the I2C specification. A slave that lost track of the clock
+// part way through a read holds SDA low waiting for more clocks, so SCL is
+// toggled up to nine times until it lets go and a STOP is sent to reset every
+// slave on the bus. The SERCOM bus state can't be trusted after that so it is
+// started over. Returns true when both lines are released.
+bool TwoWire::recoverBus()
+{
+    uint32_t start;
+    bool     released;
+
+    // Only the master is allowed to drive the clock
+    if( !_initialized || _slaveMode ) return false;
+
+    _sercom->disableInterruptsMasterWIRE();
+    _sercom->disableWIRE();
+
+    // Take both lines over as open drain GPIO, a released line is pulled high
+    // by the bus pull ups and OUTPUT drives it low
+    pinMode( _uc_pinSDA, INPUT );
+    pinMode( _uc_pinSCL, INPUT );
+    delayMicroseconds( WIRE_RECOVERY_HALF_PERIOD_MICROS );
+
+    for( uint8_t i = 0; i < 9 && !digitalRead( _uc_pinSDA ); i++ ) {
+        pinMode( _uc_pinSCL, OUTPUT );
+        delayMicroseconds( WIRE_RECOVERY_HALF_PERIOD_MICROS );
+        pinMode( _uc_pinSCL, INPUT );
+
+        // Give a slave stretching the clock a chance to release it
+        start = micros();
+        while( !digitalRead( _uc_pinSCL ) &&
+               ( micros() - start ) < WIRE_TIMEOUT_MICROS )
+            ;
+        delayMicroseconds( WIRE_RECOVERY_HALF_PERIOD_MICROS );
+    }
+
+    // STOP condition, SDA goes low while SCL is low then SDA rises while SCL
+    // is high
+    pinMode( _uc_pinSCL, OUTPUT );
+    delayMicroseconds( WIRE_RECOVERY_HALF_PERIOD_MICROS );
+    pinMode( _uc_pinSDA, OUTPUT );
+    delayMicroseconds( WIRE_RECOVERY_HALF_PERIOD_MICROS );
+    pinMode( _uc_pinSCL, INPUT );
+    delayMicroseconds( WIRE_RECOVERY_HALF_PERIOD_MICROS );
+    pinMode( _uc_pinSDA, INPUT );
+    delayMicroseconds( WIRE_RECOVERY_HALF_PERIOD_MICROS );
+
+    released = digitalRead( _uc_pinSDA ) && digitalRead( _uc_pinSCL );
+
+    // Start the SERCOM over, enabling forces the bus state back to idle
+    _sercom->initMasterWIRE( _clock, _riseTime );
+    _sercom->enableWIRE();
+    pinMode( _uc_pinSDA, gArduinoPins[_uc_pinSDA].i2c );
+    pinMode( _uc_pinSCL, gArduinoPins[_uc_pinSCL].i2c );
+
+    // Anything that was running has been abandoned
+    if( _busy ) finishTransaction( wire_timeout );
+
+    return released;
+}
+
+void TwoWire::beginTransmission( uint8_t address )
+{
+    _txAddress = address;
+    _txLength = 0;
+    _transmissionBegun = true;
+}
+
+// Errors:
+//  0 : Success
+//  1 : Data too long
+//  2 : NACK on transmit of address
+//  3 : NACK on transmit of data
+//  4 : Other error
+//  5 : Busy with an asynchronous transaction
+//  6 : Timeout
+uint8_t TwoWire::endTransmission( bool stopBit )
+{
+    if( !endTransmissionAsync( stopBit ) ) return _busy ? wire_busy : _status;
+    return waitForCompletion();
+}
+
+uint8_t TwoWire::requestFrom( uint8_t address, size_t quantity, bool stopBit )
+{
+    if( !requestFromAsync( address, quantity, stopBit ) ) return 0;
+    waitForCompletion();
+    return _rxLength;
+}
+
+bool TwoWire::endTransmissionAsync( bool stopBit, WireCallback_t cb )
+{
+    _transmissionBegun = false;
+    return startTransaction( _txAddress, _txBuffer, _txLength, NULL, 0,
+                             stopBit, cb );
+}
+
+bool TwoWire::requestFromAsync( uint8_t address, size_t quantity,
+                                bool stopBit, WireCallback_t cb )
+{
+    if( quantity == 0 ) return false;
+    if( quantity > WIRE_BUFFER_SIZE ) quantity = WIRE_BUFFER_SIZE;
+    if( _busy ) return false;
+
+    _rxIndex = 0;
+    _rxLength = 0;
+    return startTransaction( address, NULL, 0, _rxBuffer, quantity, stopBit,
+                             cb );
+}
+
+bool TwoWire::writeRead( uint8_t address, const uint8_t *txBuf, size_t txLen,
+                         uint8_t *rxBuf, size_t rxLen, WireCallback_t cb )
+{
+    if( txLen > 0 && txBuf == NULL ) return false;
+    if( rxLen > 0 && rxBuf == NULL ) return false;
+    return startTransaction( address, txBuf, txLen, rxBuf, rxLen, true, cb );
+}
+
+bool TwoWire::readRegisters( uint8_t address, uint8_t reg, uint8_t *buf,
+                             size_t len, WireCallback_t cb )
+{
+    // The register address lives in the burst buffer until the repeated start,
+    // so it can't be touched while another transaction is running
+    if( _busy ) return false;
+    _burstBuffer[0] = reg;
+    return writeRead( address, _burstBuffer, 1, buf, len, cb );
+}
+
+bool TwoWire::writeRegisters( uint8_t address, uint8_t reg, const uint8_t *buf,
+                              size_t len, WireCallback_t cb )
+{
+    if( _busy || len > WIRE_BUFFER_SIZE ) return false;
+    if( len > 0 && buf == NULL ) return false;
+
+    _burstBuffer[0] = reg;
+    memcpy( &_burstBuffer[1], buf, len );
+    return startTransaction( address, _burstBuffer, len + 1, NULL, 0, true,
+                             cb );
+}
+
+WireStatus_t TwoWire::waitForCompletion()
+{
+    uint32_t start = micros();
+    size_t   progress = _txNdx + _rxNdx;
+
+    while( _busy ) {
+        // If the SERCOM interrupt can't fire then service the bus from here
+        if( __get_PRIMASK() || !_sercom->sercomIRQEN() ) onService();
+
+        // The timeout runs per byte so long transfers aren't cut short
+        if( _txNdx + _rxNdx != progress ) {
+            progress = _txNdx + _rxNdx;
+            start = micros();
+        }
+        else if( _timeoutMicros && ( micros() - start ) > _timeoutMicros ) {
+            _timeoutFlag = true;
+            if( _resetOnTimeout ) recoverBus();
+            if( _busy ) finishTransaction( wire_timeout );
+        }
+    }
+
+    return _status;
+}
+
+size_t TwoWire::write( uint8_t ucData )
+{
+    // No writing without a transmission, or once the buffer is full
+    if( !_transmissionBegun || _txLength >= WIRE_BUFFER_SIZE ) return 0;
+
+    _txBuffer[_txLength++] = ucData;
+    return 1;
+}
+
+size_t TwoWire::write( const uint8_t *data, size_t quantity )
+{
+    for( size_t i = 0; i < quantity; ++i ) {
+        if( !write( data[i] ) ) return i;
+    }
+
+    return quantity;
+}
+
+int TwoWire::available( void )
+{
+    if( _busy ) return 0;
+    return _rxLength - _rxIndex;
+}
+
+int TwoWire::read( void )
+{
+    if( _busy || _rxIndex >= _rxLength ) return -1;
+    return _rxBuffer[_rxIndex++];
+}
+
+int TwoWire::peek( void )
+{
+    if( _busy || _rxIndex >= _rxLength ) return -1;
+    return _rxBuffer[_rxIndex];
+}
+
+void TwoWire::flush( void )
+{
+    // Do nothing, use endTransmission(..) to force data transfer.
+}
+
+bool TwoWire::startTransaction( uint8_t address, const uint8_t *txBuf,
+                                size_t txLen, uint8_t *rxBuf, size_t rxLen,
+                                bool stopBit, WireCallback_t cb )
+{
+    if( _busy ) return false;
+    if( !_initialized || _slaveMode ) {
+        _status = wire_bus_error;
+        return false;
+    }
+
+    // Wait idle or owner bus mode (owner when the last transaction skipped the
+    // stop condition)
+    if( !waitBusReady() ) {
+        _status = wire_timeout;
+        return false;
+    }
+
+    _address = address;
+    _txPtr = txBuf;
+    _txLen = txLen;
+    _txNdx = 0;
+    _rxPtr = rxBuf;
+    _rxLen = rxLen;
+    _rxNdx = 0;
+    _stop = stopBit;
+    _callback = cb;
+    _status = wire_busy;
+    _busy = true;
+
+    // Reads only go straight to a read address, everything else starts with a
+    // write address and switches to read with a repeated start. Writing the
+    // address clears any MB/SB flag left over from a transaction without a
+    // stop, so interrupts are enabled afterwards.
+    if( _txLen == 0 && _rxLen > 0 ) {
+        _phase = WIRE_PHASE_ADDR_READ;
+        _sercom->sendAddressWIRE( _address, WIRE_READ_FLAG );
+    }
+    else {
+        _phase = WIRE_PHASE_ADDR_WRITE;
+        _sercom->sendAddressWIRE( _address, WIRE_WRITE_FLAG );
+    }
+    _sercom->enableInterruptsMasterWIRE();
+
+    return true;
+}
+
+// A slave holding SDA low keeps the bus busy forever, so the wait is bounded
+// and the bus cleared when allowed
+bool TwoWire::waitBusReady( void )
+{
+    uint32_t start = micros();
+
+    while( !_sercom->isBusIdleWIRE() && !_sercom->isBusOwnerWIRE() ) {
+        if( _timeoutMicros && ( micros() - start ) > _timeoutMicros ) {
+            _timeoutFlag = true;
+            if( !_resetOnTimeout || !recoverBus() ) return false;
+            return _sercom->isBusIdleWIRE();
+        }
+    }
+
+    return true;
+}
+
+void TwoWire::finishTransaction( WireStatus_t status )
+{
+    _sercom->disableInterruptsMasterWIRE();
+
+    if( _rxPtr == _rxBuffer ) {
+        _rxIndex = 0;
+        _rxLength = _rxNdx;
+    }
+
+    _phase = WIRE_PHASE_IDLE;
+    _status = status;
+    _busy = false;
+
+    if( _callback != NULL ) _callback( status );
+}
+
+void TwoWire::setRegisterMap( volatile uint8_t *regs, uint8_t len,
+                              const uint8_t *writeMask, bool autoIncrement )
+{
+    ATOMIC_OPERATION( {
+        _regMap = regs;
+        _regLen = ( regs == NULL ) ? 0 : len;
+        _regWriteMask = writeMask;
+        _regAutoInc = autoIncrement;
+        _regPtr = 0;
+        _regChanged = false;
+    } )
+}
+
+void TwoWire::onRegisterChange( WireRegChangeCallback_t cb )
+{
+    _regChangeCallback = cb;
+}
+
+void TwoWire::regWrite( uint8_t val )
+{
+    if( _regPtr >= _regLen ) return;
+
+    uint8_t mask = ( _regWriteMask == NULL ) ? 0xFF : _regWriteMask[_regPtr];
+    if( mask ) {
+        uint8_t old = _regMap[_regPtr];
+        uint8_t upd = ( old & ~mask ) | ( val & mask );
+        _regMap[_regPtr] = upd;
+
+        if( upd != old ) {
+            if( !_regChanged ) {
+                _regChangeFirst = _regChangeLast = _regPtr;
+                _regChanged = true;
+            }
+            else {
+                if( _regPtr < _regChangeFirst ) _regChangeFirst = _regPtr;
+                if( _regPtr > _regChangeLast ) _regChangeLast = _regPtr;
+            }
+        }
+    }
+
+    regAdvance();
+}
+
+// Auto-increment runs off the end of the map back to register 0
+void TwoWire::regAdvance( void )
+{
+    if( _regAutoInc && ++_regPtr >= _regLen ) _regPtr = 0;
+}
+
+void TwoWire::regNotifyChange( void )
+{
+    if( !_regChanged ) return;
+    _regChanged = false;
+
+    if( _regChangeCallback != NULL )
+        _regChangeCallback( _regChangeFirst,
+                            _regChangeLast - _regChangeFirst + 1 );
+}
+
+void TwoWire::onSlaveService( void )
+{
+    // Stop condition, the write (if any) is complete
+    if( _sercom->isStopDetectedWIRE() ) {
+        _sercom->clearStopDetectedWIRE();
+        regNotifyChange();
+    }
+
+    if( _sercom->isAddressMatch() ) {
+        // A repeated start ends the previous write just like a stop does
+        regNotifyChange();
+
+        // Writes start with the register pointer, reads continue from it
+        _regExpectPtr = !_sercom->isMasterReadOperationWIRE();
+        _regSentFirst = false;
+
+        _sercom->prepareAckBitWIRE();
+        _sercom->prepareCommandBitsWire( 0x03 );
+    }
+    else if( _sercom->isDataReadyWIRE() ) {
+        if( _sercom->isMasterReadOperationWIRE() ) {
+
+            // The master NACKed the last byte, release the bus and wait for
+            // the stop or repeated start
+            if( _regSentFirst && _sercom->isRXNackReceivedWIRE() ) {
+                _sercom->prepareCommandBitsWire( 0x02 );
+                return;
+            }
+
+            uint8_t val = 0xFF;
+            if( _regPtr < _regLen ) {
+                val = _regMap[_regPtr];
+                regAdvance();
+            }
+
+            _sercom->writeDataSlaveWIRE( val );
+            _regSentFirst = true;
+        }
+        else {
+            // ACK the pointer and any byte that lands inside the map, the
+            // ACK/NACK goes out when DATA is read
+            if( _regExpectPtr || _regPtr < _regLen )
+                _sercom->prepareAckBitWIRE();
+            else
+                _sercom->prepareNackBitWIRE();
+
+            uint8_t val = _sercom->readDataWIRE();
+            if( _regExpectPtr ) {
+                _regPtr = val;
+                _regExpectPtr = false;
+            }
+            else {
+                regWrite( val );
+            }
+        }
+    }
+}
+
+void TwoWire::onService( void )
+{
+    if( _slaveMode ) {
+        onSlaveService();
+        return;
+    }
+
+    if( !_busy ) {
+        _sercom->disableInterruptsMasterWIRE();
+        return;
+    }
+
+    // Master on bus, an address or data byte has been written
+    if( _sercom->isMasterOnBusWIRE() ) {
+
+        // We no longer own the bus, a stop can't be sent
+        if( _sercom->isArbitrationLostWIRE() || _sercom->isBusErrorWIRE() ) {
+            finishTransaction( wire_bus_error );
+            return;
+        }
+
+        if( _sercom->isRXNackReceivedWIRE() ) {
+            _sercom->prepareCommandBitsWire( WIRE_MASTER_ACT_STOP );
+            finishTransaction( _phase == WIRE_PHASE_WRITE ? wire_data_nack
+                                                          : wire_addr_nack );
+            return;
+        }
+
+        // Send the next byte, writing DATA clears MB
+        if( _txNdx < _txLen ) {
+            _phase = WIRE_PHASE_WRITE;
+            _sercom->writeDataMasterWIRE( _txPtr[_txNdx++] );
+            return;
+        }
+
+        // Writes are done, switch to reading with a repeated start
+        if( _rxLen > 0 ) {
+            _phase = WIRE_PHASE_ADDR_READ;
+            _sercom->sendAddressWIRE( _address, WIRE_READ_FLAG );
+            return;
+        }
+
+        if( _stop ) _sercom->prepareCommandBitsWire( WIRE_MASTER_ACT_STOP );
+        finishTransaction( wire_success );
+    }
+
+    // Slave on bus, a data byte has been received. The clock is held until the
+    // next command, so read first and then ACK for more or NACK the last one.
+    else if( _sercom->isSlaveOnBusWIRE() ) {
+        _phase = WIRE_PHASE_READ;
+        _rxPtr[_rxNdx++] = _sercom->readDataWIRE();
+
+        if( _rxNdx < _rxLen ) {
+            _sercom->prepareAckBitWIRE();
+            _sercom->prepareCommandBitsWire( WIRE_MASTER_ACT_READ );
+        }
+        else {
+            _sercom->prepareNackBitWIRE();
+            if( _stop ) _sercom->prepareCommandBitsWire( WIRE_MASTER_ACT_STOP );
+            finishTransaction( wire_success );
+        }
+    }
+}
+
+#if WIRE_INTERFACES_COUNT > 0
+TwoWire Wire( &PERIPH_WIRE, PIN_WIRE_SDA, PIN_WIRE_SCL );
+
+void WIRE_IT_HANDLER( void )
+{
+    Wire.onService();
+}
+#endif
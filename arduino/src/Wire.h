@@ -0,0 +1,195 @@
+/*
+ * TwoWire.h - TWI/I2C library for Arduino Due
+ * Copyright (c) 2011 Cristian Maglie <c.maglie@arduino.cc>
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <Arduino.h>
+#include "Stream.h"
+#include "SERCOM.h"
+
+// WIRE_HAS_END means Wire has end()
+#define WIRE_HAS_END 1
+
+#define WIRE_BUFFER_SIZE 32
+
+typedef enum
+{
+    wire_success = 0,
+    wire_data_too_long = 1,
+    wire_addr_nack = 2,
+    wire_data_nack = 3,
+    wire_bus_error = 4,
+    wire_busy = 5,
+    wire_timeout = 6
+} WireStatus_t;
+
+typedef void ( *WireCallback_t )( WireStatus_t status );
+
+// Called from the SERCOM interrupt at the end of each slave write transaction
+// that modified the register map, firstReg to firstReg + count - 1 covers every
+// register that changed
+typedef void ( *WireRegChangeCallback_t )( uint8_t firstReg, uint8_t count );
+
+class TwoWire : public Stream
+{
+  public:
+    TwoWire( SERCOM *s, uint8_t pinSDA, uint8_t pinSCL );
+    void     begin();
+    void     begin( uint8_t address, bool enableGeneralCall = false );
+    void     end();
+    void     setClock( uint32_t baudrate,
+                       uint32_t riseTimeNs = WIRE_RISE_TIME_NANOSECONDS );
+    uint32_t getClock();
+
+    // Bus waits give up after timeoutMicros (0 waits forever) without the bus
+    // making progress. With resetWithTimeout the bus is then cleared and the
+    // SERCOM re-initialised.
+    void setWireTimeout( uint32_t timeoutMicros = WIRE_TIMEOUT_MICROS,
+                         bool     resetWithTimeout = true );
+    bool getWireTimeoutFlag();
+    void clearWireTimeoutFlag();
+    bool recoverBus();
+
+    void    beginTransmission( uint8_t address );
+    uint8_t endTransmission( bool stopBit = true );
+    uint8_t requestFrom( uint8_t address, size_t quantity,
+                         bool stopBit = true );
+
+    // Non-blocking versions of the above, the callback (if any) is called from
+    // the SERCOM interrupt once the transaction has completed
+    bool endTransmissionAsync( bool stopBit = true, WireCallback_t cb = NULL );
+    bool requestFromAsync( uint8_t address, size_t quantity,
+                           bool stopBit = true, WireCallback_t cb = NULL );
+
+    // Combined write then read transaction using a repeated start, reads land
+    // directly in rxBuf. Buffers must remain valid until completion.
+    bool writeRead( uint8_t address, const uint8_t *txBuf, size_t txLen,
+                    uint8_t *rxBuf, size_t rxLen, WireCallback_t cb = NULL );
+    bool readRegisters( uint8_t address, uint8_t reg, uint8_t *buf, size_t len,
+                        WireCallback_t cb = NULL );
+    bool writeRegisters( uint8_t address, uint8_t reg, const uint8_t *buf,
+                         size_t len, WireCallback_t cb = NULL );
+
+    bool isBusy()
+    {
+        return _busy;
+    }
+    WireStatus_t getStatus()
+    {
+        return _status;
+    }
+    WireStatus_t waitForCompletion();
+
+    size_t write( uint8_t data );
+    size_t write( const uint8_t *data, size_t quantity );
+
+    int  available( void );
+    int  read( void );
+    int  peek( void );
+    void flush( void );
+
+    using Print::write;
+
+    // Slave register map emulation. The first byte of each write sets the
+    // register pointer, following bytes are written through writeMask (bits
+    // set are writable, NULL makes every bit writable). Reads return the
+    // registers starting at the pointer. With autoIncrement the pointer moves
+    // on after every byte and wraps at the end of the map. Everything is
+    // served from the ISR.
+    void setRegisterMap( volatile uint8_t *regs, uint8_t len,
+                         const uint8_t *writeMask = NULL,
+                         bool           autoIncrement = true );
+    void onRegisterChange( WireRegChangeCallback_t cb );
+
+    void onService( void );
+
+  private:
+    SERCOM * _sercom;
+    uint8_t  _uc_pinSDA;
+    uint8_t  _uc_pinSCL;
+    uint32_t _clock;
+    uint32_t _riseTime;
+    bool     _initialized;
+    bool     _transmissionBegun;
+
+    // Timeout handling
+    uint32_t _timeoutMicros;
+    bool     _resetOnTimeout;
+    bool     _timeoutFlag;
+
+    // Legacy buffers used by beginTransmission/write/requestFrom
+    uint8_t _txBuffer[WIRE_BUFFER_SIZE];
+    uint8_t _txLength;
+    uint8_t _txAddress;
+    uint8_t _rxBuffer[WIRE_BUFFER_SIZE];
+    uint8_t _rxIndex;
+    uint8_t _rxLength;
+
+    // Active transaction, serviced from the interrupt handler
+    volatile bool         _busy;
+    volatile WireStatus_t _status;
+    volatile uint8_t      _phase;
+    uint8_t               _address;
+    const uint8_t *       _txPtr;
+    size_t                _txLen;
+    volatile size_t       _txNdx;
+    uint8_t *             _rxPtr;
+    size_t                _rxLen;
+    volatile size_t       _rxNdx;
+    bool                  _stop;
+    WireCallback_t        _callback;
+
+    // Holds the register address (and data) for register bursts
+    uint8_t _burstBuffer[WIRE_BUFFER_SIZE + 1];
+
+    // Slave register map
+    bool                    _slaveMode;
+    volatile uint8_t *      _regMap;
+    const uint8_t *         _regWriteMask;
+    uint8_t                 _regLen;
+    bool                    _regAutoInc;
+    volatile uint8_t        _regPtr;
+    volatile bool           _regExpectPtr;
+    volatile bool           _regSentFirst;
+    volatile uint8_t        _regChangeFirst;
+    volatile uint8_t        _regChangeLast;
+    volatile bool           _regChanged;
+    WireRegChangeCallback_t _regChangeCallback;
+
+    bool startTransaction( uint8_t address, const uint8_t *txBuf, size_t txLen,
+                           uint8_t *rxBuf, size_t rxLen, bool stopBit,
+                           WireCallback_t cb );
+    void finishTransaction( WireStatus_t status );
+    bool waitBusReady( void );
+    void onSlaveService( void );
+    void regWrite( uint8_t val );
+    void regAdvance( void );
+    void regNotifyChange( void );
+};
+
+#if WIRE_INTERFACES_COUNT > 0
+extern TwoWire Wire;
+#endif
+#if WIRE_INTERFACES_COUNT > 1
+extern TwoWire Wire1;
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+/*
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ANALOG_CAL_H_
+#define ANALOG_CAL_H_
+
+#include <stdint.h>
+
+// Temperature sensor calibration from the NVM temperature log, turned into a
+// line once at start up so conversions only need a multiply and a shift
+typedef struct
+{
+    int32_t roomADC;      // ADC result at the room calibration point
+    int32_t roomTempQ16;  // Room calibration temperature, Q16.16 degrees C
+    int32_t tempSlopeQ16; // Degrees C per ADC count, Q16.16
+} AnalogCal_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern AnalogCal_t gAnalogCal;
+
+void loadADCFactoryCal();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ANALOG_CAL_H_ */
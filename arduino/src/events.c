@@ -0,0 +1,91 @@
+/*
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "sam.h"
+#include "events.h"
+#include "clocks.h"
+#include "atomic.h"
+
+// Channels handed out by allocEventChannel, one bit per channel
+volatile uint8_t _eventChannels = 0;
+
+int8_t allocEventChannel()
+{
+    int8_t channel = -1;
+
+    ATOMIC_OPERATION( {
+        for( uint8_t i = 0; i < EVENT_CHANNEL_COUNT; i++ ) {
+            if( !( _eventChannels & ( 1 << i ) ) ) {
+                _eventChannels |= ( 1 << i );
+                channel = i;
+                break;
+            }
+        }
+    } )
+
+    if( channel != -1 ) enableAPBCClk( PM_APBCMASK_EVSYS, 1 );
+    return channel;
+}
+
+void freeEventChannel( int8_t channel )
+{
+    if( channel < 0 || channel >= EVENT_CHANNEL_COUNT ) return;
+
+    // Disconnect the generator and stop the channel clock
+    EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL( channel );
+    disableGenericClk( GCLK_CLKCTRL_ID_EVSYS_CHANNEL_0_Val + channel );
+
+    ATOMIC_OPERATION( { _eventChannels &= ~( 1 << channel ); } )
+    if( _eventChannels == 0 ) enableAPBCClk( PM_APBCMASK_EVSYS, 0 );
+}
+
+/* Note: The asynchronous path needs no clock but can't detect edges, so edge
+ * should be EVSYS_CHANNEL_EDGSEL_NO_EVT_OUTPUT_Val for it. The synchronous and
+ * resynchronized paths run the channel from GCLK0. */
+int8_t initEventChannel( int8_t channel, uint32_t generator, uint32_t path,
+                         uint32_t edge )
+{
+    if( channel < 0 || channel >= EVENT_CHANNEL_COUNT ) return -1;
+    if( path > EVSYS_CHANNEL_PATH_ASYNCHRONOUS_Val ) return -1;
+
+    enableAPBCClk( PM_APBCMASK_EVSYS, 1 );
+    if( path != EVSYS_CHANNEL_PATH_ASYNCHRONOUS_Val )
+        initGenericClk( GCLK_CLKCTRL_GEN_GCLK0_Val,
+                        GCLK_CLKCTRL_ID_EVSYS_CHANNEL_0_Val + channel );
+
+    EVSYS->CHANNEL.reg =
+        EVSYS_CHANNEL_CHANNEL( channel ) | EVSYS_CHANNEL_EVGEN( generator ) |
+        EVSYS_CHANNEL_PATH( path ) | EVSYS_CHANNEL_EDGSEL( edge );
+
+    return 0;
+}
+
+int8_t attachEventUser( int8_t channel, uint32_t user )
+{
+    if( channel < 0 || channel >= EVENT_CHANNEL_COUNT ) return -1;
+
+    // The user's channel field is the channel number plus one, zero means
+    // no channel
+    EVSYS->USER.reg =
+        EVSYS_USER_USER( user ) | EVSYS_USER_CHANNEL( channel + 1 );
+
+    return 0;
+}
+
+void detachEventUser( uint32_t user )
+{
+    EVSYS->USER.reg = EVSYS_USER_USER( user ) | EVSYS_USER_CHANNEL( 0 );
+}
@@ -0,0 +1,38 @@
+/*
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef EVENTS_H_
+#define EVENTS_H_
+
+#include <stdint.h>
+
+#define EVENT_CHANNEL_COUNT 8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int8_t allocEventChannel();
+void   freeEventChannel( int8_t channel );
+int8_t initEventChannel( int8_t channel, uint32_t generator, uint32_t path,
+                         uint32_t edge );
+int8_t attachEventUser( int8_t channel, uint32_t user );
+void   detachEventUser( uint32_t user );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENTS_H_ */
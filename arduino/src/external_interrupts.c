@@ -25,6 +25,9 @@
 #define EIC_SYNC_BUSY ( EIC->STATUS.bit.SYNCBUSY )
 #define EIC_WAIT_SYNC while( EIC_SYNC_BUSY )
 
+// Interrupt mode that leaves the sense configuration cleared
+#define SENSE_NONE 0xFF
+
 // Callback pointers for each of the external interrupts, plus an extra for the
 // non-maskable interrupt
 static void ( *ISRcallback[NUM_EXT_INTS + 1] )();
@@ -130,23 +133,18 @@ void interruptlowPowerMode( uint8_t en )
     _lowPowerModeActive = en;
 }
 
-// Sets the pin up for external interrupt mode, registers the callback function
-// with that interrupt vector if the callback is not null. Will overwrite
-// previous callback function if there was one.
-void attachInterrupt( uint32_t pin, void ( *callback )(),
-                      uint32_t interruptMode )
+// Corresponding EIC interrupt number by SAM PORTA pins, mapped directly from
+// the data sheet. Returns NUM_EXT_INTS for the NMI pin and -1 for pins with no
+// external interrupt.
+static int32_t extIntLine( uint32_t pin )
 {
     uint32_t shifter = gArduinoPins[pin].pin;
-    uint32_t EICBit = 0;
-    uint8_t  isNMI = 0;
 
     // No external interrupt on this pin
-    if( gArduinoPins[pin].extInt == -1 ) return;
+    if( gArduinoPins[pin].extInt == -1 ) return -1;
 
-    // Corresponding EIC interrupt number by SAM PORTA pins, mapped directly
-    // from the data sheet
     if( shifter < 16 ) {
-        if( shifter == 8 ) isNMI = 1;
+        if( shifter == 8 ) return NUM_EXT_INTS;
     }
     else if( shifter >= 16 && shifter < 24 )
         shifter -= 16;
@@ -155,9 +153,55 @@ void attachInterrupt( uint32_t pin, void ( *callback )(),
     else if( shifter >= 28 && shifter < 32 )
         shifter -= 20;
     else
-        return;
+        return -1;
+
+    return shifter;
+}
+
+// Sets the sense configuration of an external interrupt line
+static void setSense( uint32_t line, uint32_t interruptMode )
+{
+    // Figure out which of the two configuration registers we must use (bottom
+    // configuration for bottom 8 external interrupts, top configuration for
+    // top 8 external interrupts)
+    uint8_t config = ( line > 7 ? 1 : 0 );
+
+    // Get the bit mask offset for the bits in the configuration register
+    uint32_t pos = ( line % 8 ) * 4;
+
+    // Configure the interrupt mode
+    EIC->CONFIG[config].reg &= ~( EIC_CONFIG_SENSE0_Msk << pos );
+    switch( interruptMode ) {
+        case LOW:
+            EIC->CONFIG[config].reg |= EIC_CONFIG_SENSE0_LOW_Val << pos;
+            break;
+        case HIGH:
+            EIC->CONFIG[config].reg |= EIC_CONFIG_SENSE0_HIGH_Val << pos;
+            break;
+        case CHANGE:
+            EIC->CONFIG[config].reg |= EIC_CONFIG_SENSE0_BOTH_Val << pos;
+            break;
+        case FALLING:
+            EIC->CONFIG[config].reg |= EIC_CONFIG_SENSE0_FALL_Val << pos;
+            break;
+        case RISING:
+            EIC->CONFIG[config].reg |= EIC_CONFIG_SENSE0_RISE_Val << pos;
+            break;
+    }
+}
+
+// Sets the pin up for external interrupt mode, registers the callback function
+// with that interrupt vector if the callback is not null. Will overwrite
+// previous callback function if there was one.
+void attachInterrupt( uint32_t pin, void ( *callback )(),
+                      uint32_t interruptMode )
+{
+    int32_t  shifter = extIntLine( pin );
+    uint32_t EICBit = 0;
 
-    if( !isNMI ) {
+    if( shifter == -1 ) return;
+
+    if( shifter != NUM_EXT_INTS ) {
         EICBit = 1 << shifter;
 
         if( !_enabled ) __initialize( 0 );
@@ -171,40 +215,7 @@ void attachInterrupt( uint32_t pin, void ( *callback )(),
         // Ensure that the callback is not null
         if( callback ) {
             ISRcallback[shifter] = callback;
-
-            // Figure out which of the two configuration registers we must use
-            // (bottom configuration for bottom 8 external interrupts, top
-            // configuration for top 8 external interrupts)
-            uint8_t config = ( shifter > 7 ? 1 : 0 );
-
-            // Get the bit mask offset for the bits in the configuration
-            // register
-            uint32_t pos = shifter * 4;
-            if( pos > 28 ) pos /= 2;
-
-            // Configure the interrupt mode
-            EIC->CONFIG[config].reg &= ~( EIC_CONFIG_SENSE0_Msk << pos );
-            switch( interruptMode ) {
-                case LOW:
-                    EIC->CONFIG[config].reg |= EIC_CONFIG_SENSE0_LOW_Val << pos;
-                    break;
-                case HIGH:
-                    EIC->CONFIG[config].reg |= EIC_CONFIG_SENSE0_HIGH_Val
-                                               << pos;
-                    break;
-                case CHANGE:
-                    EIC->CONFIG[config].reg |= EIC_CONFIG_SENSE0_BOTH_Val
-                                               << pos;
-                    break;
-                case FALLING:
-                    EIC->CONFIG[config].reg |= EIC_CONFIG_SENSE0_FALL_Val
-                                               << pos;
-                    break;
-                case RISING:
-                    EIC->CONFIG[config].reg |= EIC_CONFIG_SENSE0_RISE_Val
-                                               << pos;
-                    break;
-            }
+            setSense( shifter, interruptMode );
         }
 
         // Enable the interrupt
@@ -235,28 +246,12 @@ void attachInterrupt( uint32_t pin, void ( *callback )(),
 // the callback associated with that pin.
 void detachInterrupt( uint32_t pin )
 {
-    uint32_t shifter = gArduinoPins[pin].pin;
+    int32_t  shifter = extIntLine( pin );
     uint32_t EICBit;
-    uint8_t  isNMI = 0;
-
-    // No external interrupt on this pin
-    if( gArduinoPins[pin].extInt == -1 ) return;
 
-    // Corresponding EIC interrupt number by SAM PORTA pins, mapped directly
-    // from the data sheet
-    if( shifter < 16 ) {
-        if( shifter == 8 ) isNMI = 1;
-    }
-    else if( shifter >= 16 && shifter < 24 )
-        shifter -= 16;
-    else if( shifter >= 24 && shifter < 28 )
-        shifter -= 12;
-    else if( shifter >= 28 && shifter < 32 )
-        shifter -= 20;
-    else
-        return;
+    if( shifter == -1 ) return;
 
-    if( !isNMI ) {
+    if( shifter != NUM_EXT_INTS ) {
         EICBit = 1 << shifter;
 
         // Disable ISR and wake up
@@ -275,6 +270,36 @@ void detachInterrupt( uint32_t pin )
     pinMode( pin, INPUT );
 }
 
+// Routes the pin's external interrupt to the event system rather than the
+// interrupt controller. Returns the line, the generator being
+// EVSYS_ID_GEN_EIC_EXTINT_0 + line, or -1 when the pin can't generate events.
+int8_t attachInterruptEvent( uint32_t pin, uint32_t interruptMode )
+{
+    int32_t line = extIntLine( pin );
+
+    // The NMI has no event output
+    if( line == -1 || line == NUM_EXT_INTS ) return -1;
+
+    if( !_enabled ) __initialize( 0 );
+
+    pinMode( pin, gArduinoPins[pin].extInt );
+    setSense( line, interruptMode );
+    EIC->EVCTRL.reg |= EIC_EVCTRL_EXTINTEO0 << line;
+
+    return line;
+}
+
+void detachInterruptEvent( uint32_t pin )
+{
+    int32_t line = extIntLine( pin );
+
+    if( line == -1 || line == NUM_EXT_INTS ) return;
+
+    EIC->EVCTRL.reg &= ~( EIC_EVCTRL_EXTINTEO0 << line );
+    setSense( line, SENSE_NONE );
+    pinMode( pin, INPUT );
+}
+
 void EIC_Handler()
 {
     uint32_t flags = ( EIC->INTFLAG.reg & EIC->INTENSET.reg );
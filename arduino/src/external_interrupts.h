@@ -38,6 +38,10 @@ void attachInterrupt( uint32_t pin, void ( *callback )(),
                       uint32_t interruptMode );
 void detachInterrupt( uint32_t pin );
 
+// Pin state or edges as an event generator, see external_interrupts.c
+int8_t attachInterruptEvent( uint32_t pin, uint32_t interruptMode );
+void   detachInterruptEvent( uint32_t pin );
+
 #ifdef __cplusplus
 }
 #endif
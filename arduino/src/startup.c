@@ -18,6 +18,7 @@
 
 #include "sam.h"
 #include "clocks.h"
+#include "analog_cal.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -29,6 +30,15 @@
 #define GCLK_WAIT_SYNC while( GCLK->STATUS.bit.SYNCBUSY )
 #define SYSCTRL_DFLL_WAIT_SYNC while( !SYSCTRL->PCLKSR.bit.DFLLRDY )
 
+AnalogCal_t gAnalogCal;
+
+// Temperature log fields, the whole degrees are followed by tenths
+#define TEMP_LOG_FIELD( word, name ) \
+    ( ( ( word ) & NVMCTRL_FUSES_##name##_Msk ) >> NVMCTRL_FUSES_##name##_Pos )
+#define TEMP_LOG_Q16( word, name )                             \
+    ( ( (int32_t)TEMP_LOG_FIELD( word, name##_INT ) << 16 ) + \
+      ( ( (int32_t)TEMP_LOG_FIELD( word, name##_DEC ) << 16 ) / 10 ) )
+
 void loadADCFactoryCal()
 {
     // ADC Bias Calibration
@@ -49,6 +59,19 @@ void loadADCFactoryCal()
 
     ADC->CALIB.reg =
         ADC_CALIB_BIAS_CAL( bias ) | ADC_CALIB_LINEARITY_CAL( linearity );
+
+    // Temperature sensor calibration, the only divide is done here
+    uint32_t tempLogLow = *( (uint32_t *)NVMCTRL_TEMP_LOG );
+    uint32_t tempLogHigh = *( (uint32_t *)( NVMCTRL_TEMP_LOG + 4 ) );
+    int32_t  hotTempQ16 = TEMP_LOG_Q16( tempLogLow, HOT_TEMP_VAL );
+    int32_t  hotADC = TEMP_LOG_FIELD( tempLogHigh, HOT_ADC_VAL );
+
+    gAnalogCal.roomADC = TEMP_LOG_FIELD( tempLogHigh, ROOM_ADC_VAL );
+    gAnalogCal.roomTempQ16 = TEMP_LOG_Q16( tempLogLow, ROOM_TEMP_VAL );
+    gAnalogCal.tempSlopeQ16 = 0;
+    if( hotADC != gAnalogCal.roomADC )
+        gAnalogCal.tempSlopeQ16 = ( hotTempQ16 - gAnalogCal.roomTempQ16 ) /
+                                  ( hotADC - gAnalogCal.roomADC );
 }
 
 /* The low power system initializes only the peripherals that get used during
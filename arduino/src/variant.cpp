@@ -154,9 +154,6 @@ const ArduinoGPIO_t gArduinoPins[] = {
      -1} // EXTInt, Analog
 };
 
-// TODO: See if we need this
-const void *g_apTCInstances[TC_INST_NUM] = {TC0, TC1, TC2, TC3, TC4, TC5};
-
 // Sercom objects
 SERCOM sercom0( SERCOM0 );
 SERCOM sercom1( SERCOM1 );
@@ -176,12 +173,26 @@ TimerCounter Timer( TC2 );
 TimerCounter Timer1( TC3 );
 TimerCounter Timer2( TC4 );
 TimerCounter Timer3( TC5 );
+TimerCounter Timer4( TC0 );
+TimerCounter Timer5( TC1 );
 
 // PWM objects
 PWM PWMChannel0( &Timer );
 PWM PWMChannel1( &Timer1 );
 PWM PWMChannel2( &Timer2 );
 PWM PWMChannel3( &Timer3 );
+PWM PWMChannel4( &Timer4 );
+PWM PWMChannel5( &Timer5 );
+
+void TC0_Handler()
+{
+    Timer4.IrqHandler();
+}
+
+void TC1_Handler()
+{
+    Timer5.IrqHandler();
+}
 
 void TC2_Handler()
 {
@@ -157,11 +157,15 @@ extern TimerCounter Timer;
 extern TimerCounter Timer1;
 extern TimerCounter Timer2;
 extern TimerCounter Timer3;
+extern TimerCounter Timer4;
+extern TimerCounter Timer5;
 
 extern PWM PWMChannel0;
 extern PWM PWMChannel1;
 extern PWM PWMChannel2;
 extern PWM PWMChannel3;
+extern PWM PWMChannel4;
+extern PWM PWMChannel5;
 
 extern EEEPROM EEPROM;
 
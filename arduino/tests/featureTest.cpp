@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include <SPI.h>
+#include <Wire.h>
 
 #if defined( FLUME_GA_WS_BOARD )
 #include <FXOS8700_REGISTERS.h>
@@ -42,6 +43,31 @@ void testTCContinuous();
 void testAsyncCounter();
 void testEIC();
 void testAnalog();
+void testAnalogStream();
+void testAnalogSession();
+void testAnalogScan();
+void testAnalogTimed();
+void testAnalogWindow();
+void testAnalogSampleTime();
+void testAnalogWaveform();
+void testAnalogConversion();
+void testAnalogFilter();
+void testAnalogComparator();
+void testTCPlanner();
+void testTCCapture();
+void testTimerWheel();
+void testTCStandby();
+void testTC0TC1();
+void testTCAccessSpeed();
+void testDualPWM();
+void testPWMPins();
+void testPWMFade();
+void testSoftPWM();
+void testTone();
+void testRTCAlarms();
+void testWireMaster();
+void testWireSlave();
+void testWireRecovery();
 void focusDelayTest();
 void testProcessingSpeed();
 void testWDTClear();
@@ -71,6 +97,31 @@ void loop()
             case 'i': testSPI(); break;
             case 'p': testEIC(); break;
             case 'a': testAnalog(); break;
+            case 'b': testAnalogStream(); break;
+            case 'j': testAnalogSession(); break;
+            case 'k': testAnalogScan(); break;
+            case 'l': testAnalogTimed(); break;
+            case 'n': testAnalogWindow(); break;
+            case 'o': testAnalogSampleTime(); break;
+            case 'u': testAnalogWaveform(); break;
+            case 'v': testAnalogConversion(); break;
+            case 'x': testAnalogFilter(); break;
+            case 'y': testAnalogComparator(); break;
+            case 'h': testTCPlanner(); break;
+            case '2': testTCCapture(); break;
+            case '3': testTimerWheel(); break;
+            case '4': testTCStandby(); break;
+            case '5': testTC0TC1(); break;
+            case '6': testTCAccessSpeed(); break;
+            case '7': testDualPWM(); break;
+            case '8': testPWMPins(); break;
+            case '9': testPWMFade(); break;
+            case 'A': testSoftPWM(); break;
+            case 'B': testTone(); break;
+            case 'C': testRTCAlarms(); break;
+            case 'D': testWireMaster(); break;
+            case 'E': testWireSlave(); break;
+            case 'F': testWireRecovery(); break;
             case 'f': focusDelayTest(); break;
             case 'q': testProcessingSpeed(); break;
             case 'm': testAsyncCounter(); break;
@@ -113,6 +164,469 @@ void testAnalog()
     for( uint16_t i = 0x3FF; i > 0; i-- ) highPinDefault.writeSingle( i );
 }
 
+void testAnalogStream()
+{
+    static RingBufferN<int16_t, 256> samples;
+    int16_t                          val;
+    uint32_t                         start, read = 0;
+
+    // Free running at the fastest prescaler, drain the buffer for one second
+    Analog pin( AnalogSettings( ana_ref_internal_1v, ana_resolution_12bit,
+                                ana_clk_div_4, ana_accum_1, ana_gain_1x ),
+                13 );
+    samples.Flush();
+    if( !pin.beginStream( &samples ) ) {
+        Serial.println( "Stream failed to start" );
+        return;
+    }
+
+    start = millis();
+    while( millis() - start < 1000 ) {
+        while( samples.DeQueue( &val ) ) read++;
+    }
+
+    sprintf( _printBuff,
+             "Free run: %lu Hz, %lu read, %lu dropped, %lu overruns",
+             Analog::getStreamSampleRate(), read, Analog::getStreamDropped(),
+             Analog::getStreamOverruns() );
+    Serial.println( _printBuff );
+
+    // Not draining the buffer should show up as dropped samples
+    delay( 100 );
+    Analog::endStream();
+    sprintf( _printBuff, "Undrained: %lu dropped", Analog::getStreamDropped() );
+    Serial.println( _printBuff );
+
+    // Restarting each conversion from the interrupt
+    samples.Flush();
+    read = 0;
+    pin.beginStream( &samples, ana_trig_software );
+    start = millis();
+    while( millis() - start < 1000 ) {
+        while( samples.DeQueue( &val ) ) read++;
+    }
+    Analog::endStream();
+
+    sprintf( _printBuff, "Software: %lu Hz, %lu read, %lu dropped",
+             Analog::getStreamSampleRate(), read, Analog::getStreamDropped() );
+    Serial.println( _printBuff );
+}
+
+void testAnalogSession()
+{
+    Analog   pinA( 13 ), pinB( 17 );
+    uint32_t start, single, session, alternating;
+    int32_t  sum = 0;
+
+    // Per sample latency of readSingle, which powers up and configures the
+    // ADC and throws away a conversion every time
+    start = micros();
+    for( uint16_t i = 0; i < 1000; i++ ) sum += pinA.readSingle();
+    single = micros() - start;
+
+    // Same channel inside a session, only the conversion itself
+    pinA.beginSession();
+    start = micros();
+    for( uint16_t i = 0; i < 1000; i++ ) sum += pinA.read();
+    session = micros() - start;
+
+    // Alternating channels with the same reference, reconfigures but still
+    // skips the throw away conversion
+    start = micros();
+    for( uint16_t i = 0; i < 500; i++ ) sum += pinA.read() + pinB.read();
+    alternating = micros() - start;
+    Analog::endSession();
+
+    sprintf( _printBuff,
+             "Per sample: readSingle %lu ns, session %lu ns, alternating %lu "
+             "ns (%ld)",
+             single, session, alternating, sum );
+    Serial.println( _printBuff );
+}
+
+void testAnalogScan()
+{
+    // AIN4 - AIN7 are contiguous, the second list has to be chained
+    const int32_t contiguous[] = {14, 15, 16, 17};
+    const int32_t chained[] = {13, 17, 14};
+    AnalogScan    scanA( contiguous, 4 ), scanB( chained, 3 );
+    int16_t       results[4];
+    uint32_t      start, elapsed;
+    uint8_t       i;
+
+    sprintf( _printBuff, "Contiguous %d, chained %d", scanA.isContiguous(),
+             scanB.isContiguous() );
+    Serial.println( _printBuff );
+
+    // First scan pays for the set up, the second one doesn't
+    for( uint8_t pass = 0; pass < 2; pass++ ) {
+        start = micros();
+        scanA.read( results );
+        elapsed = micros() - start;
+
+        i = sprintf( _printBuff, "INPUTSCAN %lu us:", elapsed );
+        for( uint8_t n = 0; n < 4; n++ )
+            i += sprintf( &_printBuff[i], " %d", results[n] );
+        Serial.println( _printBuff );
+    }
+    scanA.end();
+
+    start = micros();
+    scanB.read( results );
+    elapsed = micros() - start;
+    scanB.end();
+
+    i = sprintf( _printBuff, "Chained %lu us:", elapsed );
+    for( uint8_t n = 0; n < 3; n++ )
+        i += sprintf( &_printBuff[i], " %d", results[n] );
+    Serial.println( _printBuff );
+}
+
+void testAnalogTimed()
+{
+    static RingBufferN<int16_t, 256> samples;
+    Analog                           pin( 13 );
+    int16_t                          val;
+    uint32_t                         start, read = 0;
+
+    // Sample at 10kHz off the overflow event of TC2
+    samples.Flush();
+    if( !pin.beginStream( &samples, &Timer, 10000 ) ) {
+        Serial.println( "Timed stream failed to start" );
+        return;
+    }
+
+    start = millis();
+    while( millis() - start < 1000 ) {
+        while( samples.DeQueue( &val ) ) read++;
+    }
+
+    // Measured rate should match the timer rate to within the millis() error
+    sprintf( _printBuff,
+             "Timer %lu Hz, measured %lu Hz, %lu read, %lu dropped, %lu "
+             "overruns",
+             Timer.getOverflowFrequency(), Analog::getStreamSampleRate(), read,
+             Analog::getStreamDropped(), Analog::getStreamOverruns() );
+    Analog::endStream();
+    Serial.println( _printBuff );
+}
+
+void testAnalogSampleTime()
+{
+    const uint32_t ohms[] = {0, 100, 1000, 10000, 50000, 100000};
+    AnalogSettings settings( ana_ref_internal_1v, ana_resolution_12bit,
+                             ana_clk_div_8, ana_accum_1, ana_gain_1x );
+    uint32_t       start, elapsed;
+    int32_t        sum;
+
+    // Per conversion time for the default (longest) sample time and then for
+    // each source impedance
+    for( uint8_t i = 0; i < sizeof( ohms ) / sizeof( ohms[0] ); i++ ) {
+        if( ohms[i] ) settings.setSourceImpedance( ohms[i] );
+        Analog pin( settings, 13 );
+
+        sum = 0;
+        pin.beginSession();
+        start = micros();
+        for( uint16_t n = 0; n < 1000; n++ ) sum += pin.read();
+        elapsed = micros() - start;
+        Analog::endSession();
+
+        sprintf( _printBuff, "%lu ohms: SAMPLEN %d, %lu ns per read, avg %ld",
+                 ohms[i], settings.getSampleLength(), elapsed, sum / 1000 );
+        Serial.println( _printBuff );
+    }
+}
+
+void testAnalogConversion()
+{
+    AnalogSettings settings( ana_ref_internal_0_5_vddana, ana_resolution_12bit,
+                             ana_clk_div_8, ana_accum_1, ana_gain_1x );
+    Analog         pin( settings, 13 );
+    uint32_t       start, measured, cached;
+    int16_t        val;
+
+    // First read measures the band gap, the second comes from the cache
+    Analog::setVCCCacheTime( 0 );
+    start = micros();
+    Analog::readVCC();
+    measured = micros() - start;
+
+    Analog::setVCCCacheTime( ANALOG_VCC_CACHE_MILLIS );
+    Analog::readVCC();
+    start = micros();
+    val = Analog::readVCC();
+    cached = micros() - start;
+
+    sprintf( _printBuff, "VCC %d mV, measured in %lu us, cached in %lu us", val,
+             measured, cached );
+    Serial.println( _printBuff );
+
+    sprintf( _printBuff, "Temperature %d C", Analog::readTemperature() );
+    Serial.println( _printBuff );
+
+    // Pin 13 is tied high so should read VCC and a ratio of 1.0 (65536)
+    val = pin.readSingle();
+    start = micros();
+    for( uint16_t i = 0; i < 1000; i++ ) pin.toMillivolts( val );
+    measured = micros() - start;
+    sprintf( _printBuff, "%d counts, %ld mV, ratio %ld, %lu ns per conversion",
+             val, pin.toMillivolts( val ), pin.toRatio( val ), measured );
+    Serial.println( _printBuff );
+}
+
+// Cycles per input sample for a block of 256
+#define CYCLES_PER_SAMPLE( us ) \
+    ( ( ( us ) * ( SystemCoreClock / 1000000ul ) ) / 256 )
+
+void testAnalogFilter()
+{
+    // 16 tap low pass, Q15
+    static const int16_t lowPass[16] = {
+        -120, -260, -180, 420,  1620, 3160, 4480, 5260,
+        5260, 4480, 3160, 1620, 420,  -180, -260, -120};
+    // 2nd order low pass at fs / 20, Q14
+    static const AnalogBiquad_t biquad[2] = {{329, 658, 329, -24322, 9254},
+                                             {329, 658, 329, -24322, 9254}};
+    static RingBufferN<int16_t, 1024> samples;
+    static int16_t                    in[256];
+    static int32_t                    block[256];
+    AnalogDecimator                   cic1( 1, 8 ), cic3( 3, 4 );
+    AnalogDecimator                   cicMax( 1, 19 ), cicOver( 4, 5 );
+    AnalogFIR                         fir( lowPass, 16 );
+    AnalogIIR                         iir( biquad, 2 );
+    Analog                            pin( 13 );
+    uint32_t                          start, n, cycles[5];
+
+    for( uint16_t i = 0; i < 256; i++ ) {
+        in[i] = 2048 + ( ( i * 37 ) & 0x3F );
+        block[i] = in[i] << 4;
+    }
+
+    start = micros();
+    cic1.process( in, 256, block );
+    cycles[0] = CYCLES_PER_SAMPLE( micros() - start );
+
+    start = micros();
+    cic3.process( in, 256, block );
+    cycles[1] = CYCLES_PER_SAMPLE( micros() - start );
+
+    for( uint16_t i = 0; i < 256; i++ ) block[i] = in[i] << 4;
+    start = micros();
+    fir.process( block, 256 );
+    cycles[2] = CYCLES_PER_SAMPLE( micros() - start );
+
+    start = micros();
+    iir.process( block, 256 );
+    cycles[3] = CYCLES_PER_SAMPLE( micros() - start );
+
+    sprintf( _printBuff,
+             "Cycles per sample: moving average %lu, CIC3 %lu, FIR16 %lu, "
+             "IIR2 %lu",
+             cycles[0], cycles[1], cycles[2], cycles[3] );
+    Serial.println( _printBuff );
+
+    // Full scale DC through the most growth allowed comes out at full scale
+    for( uint16_t i = 0; i < 256; i++ ) in[i] = 4095;
+    n = 0;
+    for( uint16_t i = 0; i < 2048; i++ ) n += cicMax.process( in, 256, block );
+    sprintf( _printBuff,
+             "Full scale DC: %lu outputs, last %ld (expected 1, 65520), growth "
+             "20 %s",
+             n, block[0], cicOver.isValid() ? "accepted" : "rejected" );
+    Serial.println( _printBuff );
+
+    // 16 bit effective output from the stream, sleeping between blocks
+    samples.Flush();
+    cic1.reset();
+    if( !pin.beginStream( &samples, &Timer, 64000 ) ) {
+        Serial.println( "Stream failed to start" );
+        return;
+    }
+
+    n = 0;
+    start = millis();
+    cycles[4] = 0;
+    while( millis() - start < 1000 ) {
+        sleepCPU( _cpu );
+        if( samples.GetNumObjStored() < 256 ) continue;
+
+        uint32_t t = micros();
+        n += cic1.process( &samples, block, 256 );
+        cycles[4] += micros() - t;
+    }
+    Analog::endStream();
+
+    sprintf( _printBuff, "%lu outputs, last %ld, %lu us filtering, %lu dropped",
+             n, block[0], cycles[4], Analog::getStreamDropped() );
+    Serial.println( _printBuff );
+}
+
+#define WAVE_LEN 64
+
+volatile uint32_t _waveRefills = 0;
+uint16_t          _waveLevel = 0;
+
+// Keeps a rising ramp going across the two buffers
+void waveRefill( uint16_t *buf, uint32_t count )
+{
+    for( uint32_t i = 0; i < count; i++ ) {
+        buf[i] = _waveLevel;
+        _waveLevel = ( _waveLevel + 4 ) & 0x3FF;
+    }
+    _waveRefills++;
+}
+
+void testAnalogWaveform()
+{
+    static uint16_t triangle[WAVE_LEN], bufA[WAVE_LEN], bufB[WAVE_LEN];
+    Analog          dac( DAC0 );
+    uint32_t        expected;
+
+    for( uint16_t i = 0; i < WAVE_LEN / 2; i++ ) {
+        triangle[i] = i * ( 0x3FF / ( WAVE_LEN / 2 ) );
+        triangle[WAVE_LEN - 1 - i] = triangle[i];
+    }
+
+    // One shot off the overflow event, should stop on its own after
+    // WAVE_LEN samples
+    if( !dac.beginWaveform( triangle, WAVE_LEN, &Timer, 32000 ) ) {
+        Serial.println( "Waveform failed to start" );
+        return;
+    }
+    delay( 10 );
+    sprintf( _printBuff, "One shot: playing %d, %lu played, %lu underruns",
+             Analog::isPlaying(), Analog::getWaveformCount(),
+             Analog::getWaveformUnderruns() );
+    Serial.println( _printBuff );
+
+    // 500Hz triangle looped for a second, event then timer interrupt paced
+    for( uint8_t i = 0; i < 2; i++ ) {
+        dac.beginWaveform( triangle, WAVE_LEN, &Timer, 500 * WAVE_LEN, true,
+                           i ? ana_trig_software : ana_trig_event );
+        delay( 1000 );
+        expected = Timer.getOverflowFrequency();
+        Analog::endWaveform();
+        sprintf( _printBuff,
+                 "%s loop: %lu played, %lu expected, %lu underruns",
+                 i ? "ISR" : "Event", Analog::getWaveformCount(), expected,
+                 Analog::getWaveformUnderruns() );
+        Serial.println( _printBuff );
+    }
+
+    // Double buffered ramp, each buffer is refilled as the other plays
+    _waveRefills = 0;
+    waveRefill( bufA, WAVE_LEN );
+    waveRefill( bufB, WAVE_LEN );
+    dac.beginWaveform( bufA, bufB, WAVE_LEN, waveRefill, &Timer, 16000 );
+    delay( 1000 );
+    Analog::endWaveform();
+    sprintf( _printBuff, "Double buffer: %lu refills, %lu played, %lu "
+                         "underruns",
+             _waveRefills - 2, Analog::getWaveformCount(),
+             Analog::getWaveformUnderruns() );
+    Serial.println( _printBuff );
+}
+
+volatile uint32_t _windowHits = 0;
+
+void windowISR( int16_t value )
+{
+    _windowHits++;
+}
+
+void testAnalogWindow()
+{
+    Analog         pin( 13 );
+    AnalogSettings settings( ana_ref_internal_1v, ana_resolution_12bit,
+                             ana_clk_div_8, ana_accum_16, ana_gain_1x );
+    Analog         averaged( settings, 13 );
+    uint32_t       start;
+
+    // 16 conversions of 40 cycles a sample is only 12Hz at 8kHz
+    sprintf( _printBuff, "Window max rates: %lu Hz, %lu Hz averaged by 16",
+             pin.getWindowMaxRate(), averaged.getWindowMaxRate() );
+    Serial.println( _printBuff );
+    if( averaged.beginWindow( 1000, 3000, &Timer, 100 ) ) {
+        Serial.println( "Averaged window FAILED to be refused at 100Hz" );
+        Analog::endWindow();
+    }
+
+    // Sample 100 times a second, sleep in standby until the pin leaves
+    // 1000 - 3000 counts
+    _windowHits = 0;
+    if( !pin.beginWindow( 1000, 3000, &Timer, 100, ana_window_outside,
+                          windowISR, true ) ) {
+        Serial.println( "Window failed to start" );
+        return;
+    }
+
+    Serial.println( "Move pin 13 outside the window" );
+    Serial.flush();
+    start = millis();
+    while( !Analog::isWindowTriggered() && millis() - start < 10000 )
+        sleepCPU( _deep_sleep );
+
+    sprintf( _printBuff, "Triggered %d at %d after %lu ms, %lu callbacks",
+             Analog::isWindowTriggered(), Analog::getWindowValue(),
+             millis() - start, _windowHits );
+    Serial.println( _printBuff );
+
+    // One shot, nothing more until re-armed
+    delay( 100 );
+    sprintf( _printBuff, "%lu callbacks after 100ms", _windowHits );
+    Serial.println( _printBuff );
+    Analog::endWindow();
+}
+
+volatile uint32_t _acCrossings = 0;
+volatile bool     _acState = false;
+
+void comparatorISR( bool state )
+{
+    _acCrossings++;
+    _acState = state;
+}
+
+void testAnalogComparator()
+{
+    AnalogComparator halfVDD( 14, ac_ref_vscale, 31 );
+    AnalogComparator bandgap( 15, ac_ref_bandgap );
+    AnalogComparator noPin( 4, ac_ref_gnd );
+
+    // Not an AC pin
+    if( !noPin.begin() ) Serial.println( "Non-AC pin successfully rejected" );
+
+    // Pin 14 against VDD / 2, once single shot and once continuous
+    halfVDD.begin( ac_single_shot );
+    sprintf( _printBuff, "Single shot: pin 14 %s VDD / 2",
+             halfVDD.read() ? "above" : "below" );
+    Serial.println( _printBuff );
+    halfVDD.end();
+
+    halfVDD.begin( ac_continuous, true );
+    bandgap.begin();
+    sprintf( _printBuff, "Continuous: pin 14 %s VDD / 2, pin 15 %s 1.1V",
+             halfVDD.read() ? "above" : "below",
+             bandgap.read() ? "above" : "below" );
+    Serial.println( _printBuff );
+    bandgap.end();
+    halfVDD.end();
+
+    // Deep sleep until pin 14 crosses VDD / 2
+    _acCrossings = 0;
+    halfVDD.begin( ac_continuous, true, true );
+    halfVDD.attachInterrupt( comparatorISR );
+    Serial.println( "Sleeping until pin 14 crosses VDD / 2" );
+    Serial.flush();
+    while( _acCrossings == 0 ) sleepCPU( _deep_sleep );
+
+    sprintf( _printBuff, "Woken by a crossing, pin 14 now %s VDD / 2",
+             _acState ? "above" : "below" );
+    Serial.println( _printBuff );
+    halfVDD.end();
+}
+
 void EICISR()
 {
 #if defined( FLUME_GA_WS_BOARD )
@@ -892,6 +1406,784 @@ void testProcessingSpeed()
     Serial.println( results[0] );
 }
 
+void testTCPlanner()
+{
+    const TCMode_t modes[] = {tc_mode_8_bit, tc_mode_16_bit, tc_mode_32_bit};
+    uint32_t       freq, worstFreq, start, plans;
+    int32_t        worst;
+
+    // Worst error over 1Hz to half the CPU clock for each counter size
+    for( uint8_t m = 0; m < 3; m++ ) {
+        worst = 0;
+        worstFreq = 0;
+        plans = 0;
+        start = micros();
+        for( freq = 1; freq <= SystemCoreClock / 2; freq += freq / 8 + 1 ) {
+            TCPlan_t plan = planTCFrequency(
+                SystemCoreClock, freq,
+                m == 0 ? 0xFF : ( m == 1 ? 0xFFFF : 0xFFFFFFFF ) );
+            if( abs( plan.ppm ) > abs( worst ) ) {
+                worst = plan.ppm;
+                worstFreq = freq;
+            }
+            plans++;
+        }
+
+        sprintf( _printBuff, "Mode %d: worst %ld ppm at %lu Hz, %lu us per plan",
+                 m, worst, worstFreq, ( micros() - start ) / plans );
+        Serial.println( _printBuff );
+    }
+
+    // The timer reports the plan it used
+    for( uint8_t m = 0; m < 3; m++ ) {
+        Timer.begin( 12345, false, modes[m], false );
+        sprintf( _printBuff, "12345 Hz: got %lu Hz, %ld ppm, overflow %lu Hz",
+                 Timer.getFrequency(), Timer.getFrequencyError(),
+                 Timer.getOverflowFrequency() );
+        Serial.println( _printBuff );
+        Timer.end();
+    }
+}
+
+volatile uint32_t _captureCount;
+
+void captureCallback( uint32_t period, uint32_t width )
+{
+    _captureCount++;
+}
+
+void testTCCapture()
+{
+    uint32_t period, width, ticks;
+
+    // Jumper pin 6 (Timer PWM output) to pin 14
+    Timer.beginPWM( 1000, 25 );
+
+    if( !Timer3.beginCapture( 14 ) )
+        Serial.println( "Odd timer successfully rejected for 32 bit capture" );
+
+    Timer2.beginCapture( 14, tc_capture_ppw );
+    ticks = Timer2.getTickFrequency();
+
+    // Nothing to do until a whole period has been captured
+    while( !Timer2.readCapture( &period, &width ) ) sleepCPU( _cpu );
+    sprintf( _printBuff, "PPW: period %lu, width %lu ticks at %lu Hz", period,
+             width, ticks );
+    Serial.println( _printBuff );
+
+    if( period != 0 ) {
+        sprintf( _printBuff, "%lu Hz, %lu%% duty", ticks / period,
+                 width * 100 / period );
+        Serial.println( _printBuff );
+    }
+    Timer2.endCapture();
+
+    // Low time instead, through the callback
+    _captureCount = 0;
+    Timer2.beginCapture( 14, tc_capture_pwp, tc_mode_32_bit,
+                         TC_CTRLA_PRESCALER_DIV1_Val, true );
+    Timer2.onCapture( captureCallback );
+    delay( 100 );
+    Timer2.readCapture( &period, &width );
+    sprintf( _printBuff, "PWP inverted: %lu captures, period %lu, width %lu, "
+                         "%lu errors",
+             _captureCount, period, width, Timer2.getCaptureErrors() );
+    Serial.println( _printBuff );
+    Timer2.endCapture();
+
+    Timer.end();
+}
+
+#define WHEEL_BENCH_TIMERS 1000
+#define WHEEL_CYCLES_PER_TIMER( us ) \
+    ( ( ( us ) * ( SystemCoreClock / 1000000ul ) ) / WHEEL_BENCH_TIMERS )
+
+volatile uint32_t _wheelFired;
+
+void wheelCallback( SoftTimer_t *timer )
+{
+    _wheelFired++;
+}
+
+void testTimerWheel()
+{
+    static SoftTimer_t timers[WHEEL_BENCH_TIMERS], once;
+    TimerWheel         bench( NULL );
+    TimerWheel         wheel( &Timer1 );
+    uint32_t           start, i;
+
+    // Stepped by hand so only the wheel is timed
+    _wheelFired = 0;
+    start = micros();
+    for( i = 0; i < WHEEL_BENCH_TIMERS; i++ ) {
+        bench.start( &timers[i], wheelCallback, i % 500 + 1,
+                     i % 3 ? i % 97 + 1 : 0 );
+    }
+    sprintf( _printBuff, "%d timers: %lu cycles per start", WHEEL_BENCH_TIMERS,
+             WHEEL_CYCLES_PER_TIMER( micros() - start ) );
+    Serial.println( _printBuff );
+
+    start = micros();
+    bench.advance( 1000 );
+    sprintf( _printBuff, "1000 ticks: %lu fired, %lu us, %lu still armed",
+             _wheelFired, micros() - start, bench.getArmedCount() );
+    Serial.println( _printBuff );
+
+    start = micros();
+    for( i = 0; i < WHEEL_BENCH_TIMERS; i++ ) bench.cancel( &timers[i] );
+    sprintf( _printBuff, "%lu cycles per cancel",
+             WHEEL_CYCLES_PER_TIMER( micros() - start ) );
+    Serial.println( _printBuff );
+
+    // On the hardware, a periodic timer every 10ms and a one shot at 1s
+    wheel.begin( 1000 );
+    _wheelFired = 0;
+    wheel.start( &timers[0], wheelCallback, 10, 10 );
+    wheel.start( &once, wheelCallback, 1000 );
+    start = millis();
+    while( TimerWheel::isArmed( &once ) ) sleepCPU( _cpu );
+    sprintf( _printBuff, "One shot after %lu ms (%lu Hz ticks), %lu fired",
+             millis() - start, wheel.getTickFrequency(), _wheelFired );
+    Serial.println( _printBuff );
+    wheel.end();
+}
+
+volatile uint32_t _standbyWakes;
+
+void standbyISR()
+{
+    _standbyWakes++;
+}
+
+void testTCStandby()
+{
+    uint64_t start;
+
+    // Wraps 8 times a second from the 32kHz clock, each one wakes the CPU
+    _standbyWakes = 0;
+    Timer1.registerISR( standbyISR );
+    Timer1.begin( 4, false, tc_mode_16_bit, true, true );
+    sprintf( _printBuff, "Standby timer: %lu Hz, %ld ppm, %lu Hz wraps",
+             Timer1.getFrequency(), Timer1.getFrequencyError(),
+             Timer1.getOverflowFrequency() );
+    Serial.println( _printBuff );
+    Serial.flush();
+
+    start = stepsRTC();
+    while( _standbyWakes < 16 ) sleepCPU( _deep_sleep );
+    sprintf( _printBuff, "16 wakes from deep sleep in %lu ms",
+             ( uint32_t )( RTC_EXACT_STEPS_TO_MILLIS( stepsRTC() - start ) ) );
+    Serial.println( _printBuff );
+
+    Timer1.end();
+    Timer1.deregisterISR();
+}
+
+volatile uint32_t _tc0Wraps;
+
+void tc0ISR()
+{
+    _tc0Wraps++;
+}
+
+void testTC0TC1()
+{
+    uint32_t start;
+
+    // The odd half of a pair can't count 32 bits on its own
+    Timer5.begin( 1000, false, tc_mode_32_bit );
+    if( !Timer5.isActive() )
+        Serial.println( "TC1 successfully rejected for 32 bit mode" );
+    Timer5.end();
+
+    // TC0/TC1 as a 32 bit pair toggling pin 14, 10 wraps a second
+    _tc0Wraps = 0;
+    Timer4.registerISR( tc0ISR );
+    Timer4.begin( 5, true, tc_mode_32_bit, true );
+    start = millis();
+    delay( 1000 );
+    sprintf( _printBuff, "TC0 32 bit: %lu wraps in %lu ms, period %lu",
+             _tc0Wraps, millis() - start, Timer4.getPeriod() );
+    Serial.println( _printBuff );
+    Timer4.end();
+    Timer4.deregisterISR();
+
+    // TC1 on its own, PWM on pin 17
+    Timer5.beginPWM( 1000, 50 );
+    sprintf( _printBuff, "TC1 PWM: %lu Hz", Timer5.getOverflowFrequency() );
+    Serial.println( _printBuff );
+    delay( 100 );
+    Timer5.end();
+}
+
+// Cycles between two SysTick reads, it counts down and reloads every tick
+#define SYSTICK_CYCLES( start, end )                                     \
+    ( ( ( start ) - ( end ) + SysTick->LOAD + 1 ) % ( SysTick->LOAD + 1 ) )
+#define TC_SPEED_LOOPS 100
+
+volatile uint32_t _irqEnterTick;
+
+void latencyISR()
+{
+    _irqEnterTick = SysTick->VAL;
+}
+
+void testTCAccessSpeed()
+{
+    TimerCounterT<tc_mode_16_bit> fixed( TC5 );
+    volatile uint32_t             sink;
+    uint32_t                      start, total;
+
+    // Interrupt entry to the callback, the interrupt is raised by software
+    Timer1.registerISR( latencyISR );
+    Timer1.begin( 1, false, tc_mode_16_bit, true );
+    total = 0;
+    for( uint8_t i = 0; i < TC_SPEED_LOOPS; i++ ) {
+        start = SysTick->VAL;
+        _irqEnterTick = start;
+        NVIC_SetPendingIRQ( TC3_IRQn );
+        while( _irqEnterTick == start )
+            ;
+        total += SYSTICK_CYCLES( start, _irqEnterTick );
+    }
+    sprintf( _printBuff, "IRQ to callback: %lu cycles", total / TC_SPEED_LOOPS );
+    Serial.println( _printBuff );
+    Timer1.end();
+    Timer1.deregisterISR();
+
+    // getCount() picking the register at run time and at compile time
+    Timer3.begin( 1000, false, tc_mode_16_bit );
+    start = SysTick->VAL;
+    for( uint8_t i = 0; i < TC_SPEED_LOOPS; i++ ) sink = Timer3.getCount();
+    total = SYSTICK_CYCLES( start, SysTick->VAL );
+    Timer3.end();
+
+    fixed.begin( 1000 );
+    start = SysTick->VAL;
+    for( uint8_t i = 0; i < TC_SPEED_LOOPS; i++ ) sink = fixed.getCount();
+    sprintf( _printBuff, "getCount(): %lu cycles, %lu fixed to 16 bit",
+             total / TC_SPEED_LOOPS,
+             SYSTICK_CYCLES( start, SysTick->VAL ) / TC_SPEED_LOOPS );
+    Serial.println( _printBuff );
+    fixed.end();
+}
+
+void printPWMDuty( uint16_t duty )
+{
+    uint32_t period, width;
+
+    // Let the change through then wait for a whole new period
+    delay( 5 );
+    Timer2.readCapture( &period, &width );
+    while( !Timer2.readCapture( &period, &width ) )
+        ;
+    sprintf( _printBuff, "Duty %u/65536: width %lu of %lu ticks", duty, width,
+             period );
+    Serial.println( _printBuff );
+}
+
+void testDualPWM()
+{
+    static const uint16_t duties[] = {0x0100, 0x4000, 0x8000, 0xFF00};
+
+    // Only the prescaler moves a 16 bit period, at 48MHz 366Hz keeps all 16
+    // bits but 500Hz is 27% off that so it drops to 8 bits at 498Hz with a
+    // top of 93
+    PWMChannel0.beginDual( 366, 0x8000, 0x4000 );
+    sprintf( _printBuff, "Dual PWM: %lu Hz, %u bits", PWMChannel0.getFrequency(),
+             PWMChannel0.getResolution() );
+    Serial.println( _printBuff );
+    PWMChannel0.end();
+
+    PWMChannel0.beginDual( 500, 0x8000, 0x4000 );
+    sprintf( _printBuff, "Dual PWM: %lu Hz, %u bits, %ld ppm",
+             PWMChannel0.getFrequency(), PWMChannel0.getResolution(),
+             Timer.getFrequencyError() );
+    Serial.println( _printBuff );
+    PWMChannel0.end();
+
+    PWMChannel0.beginDual( 100000, 0x8000, 0x4000 );
+    sprintf( _printBuff, "Dual PWM: %lu Hz, %u bits", PWMChannel0.getFrequency(),
+             PWMChannel0.getResolution() );
+    Serial.println( _printBuff );
+
+    // Jumper pin 6 to pin 14, every duty should measure whole with no
+    // captures lost to a short or long pulse while it changes
+    Timer2.beginCapture( 14, tc_capture_ppw );
+    for( uint8_t i = 0; i < sizeof( duties ) / sizeof( duties[0] ); i++ ) {
+        PWMChannel0.setDuty( duties[i] );
+        printPWMDuty( duties[i] );
+    }
+    sprintf( _printBuff, "%lu capture errors", Timer2.getCaptureErrors() );
+    Serial.println( _printBuff );
+    Timer2.endCapture();
+
+    PWMChannel0.end();
+}
+
+void testPWMPins()
+{
+    // Pin 6 is TC2's, pin 13 has no timer function
+    if( !PWMChannel5.setPin( 6 ) ) Serial.println( "Pin 6 rejected for TC1" );
+    if( !PWMChannel5.setPin( 13 ) ) Serial.println( "Pin 13 rejected for TC1" );
+
+    // TC1 WO[1] moved from pin 17 (PA07) to pin 2 (PA11)
+    PWMChannel5.setPin( 2 );
+    PWMChannel5.begin( 1000, 25 );
+    sprintf( _printBuff, "TC1 PWM on pin %d at %lu Hz", Timer5.getOutputPin( 1 ),
+             PWMChannel5.getFrequency() );
+    Serial.println( _printBuff );
+    if( !PWMChannel5.setPin( 17 ) )
+        Serial.println( "Pin change rejected while running" );
+    delay( 100 );
+    PWMChannel5.end();
+    PWMChannel5.setPin( 17 );
+}
+
+volatile bool _fadeDone;
+
+void fadeCallback( uint8_t channel )
+{
+    _fadeDone = true;
+}
+
+void testPWMFade()
+{
+    static const char *names[] = {"Linear", "Gamma", "Exponential"};
+    uint32_t            start;
+
+    // LED on pin 6, up and back down along each curve with the CPU asleep
+    PWMChannel0.begin( 1000, 0 );
+    for( uint8_t c = tc_fade_linear; c <= tc_fade_exponential; c++ ) {
+        _fadeDone = false;
+        start = millis();
+        PWMChannel0.fade( 0, PWM_DUTY_MAX, 1000, (TCFadeCurve_t)c,
+                          fadeCallback );
+        while( !_fadeDone ) sleepCPU( _cpu );
+        sprintf( _printBuff, "%s fade up in %lu ms", names[c],
+                 millis() - start );
+        Serial.println( _printBuff );
+
+        PWMChannel0.fade( PWM_DUTY_MAX, 0, 1000, (TCFadeCurve_t)c );
+        while( PWMChannel0.isFading() ) sleepCPU( _cpu );
+    }
+
+    // Cut short by setting the duty
+    PWMChannel0.fade( 0, PWM_DUTY_MAX, 1000 );
+    delay( 500 );
+    PWMChannel0.setDuty( PWM_DUTY_MAX / 4 );
+    if( !PWMChannel0.isFading() ) Serial.println( "Fade stopped by setDuty()" );
+
+    PWMChannel0.end();
+}
+
+void testSoftPWM()
+{
+    static const uint8_t  pins[] = {6, 7, 8, 11, 12, 2, 3, 4};
+    static const uint16_t duties[] = {0x4000, 0x1000, 0x2000, 0x4000,
+                                      0x8000, 0xC000, 0,      PWM_DUTY_MAX};
+    SoftPWM               soft( &Timer1 );
+    uint32_t              period, width;
+
+    for( uint8_t i = 0; i < sizeof( pins ); i++ )
+        soft.attach( pins[i], duties[i] );
+    if( !soft.begin( 1000 ) ) {
+        Serial.println( "SoftPWM begin failed" );
+        return;
+    }
+    sprintf( _printBuff, "SoftPWM: %lu Hz, %lu steps", soft.getFrequency(),
+             soft.getSteps() );
+    Serial.println( _printBuff );
+
+    // Jumper pin 6 to pin 14
+    Timer2.beginCapture( 14, tc_capture_ppw );
+    for( uint16_t duty = 0x1000; duty != 0; duty += 0x3000 ) {
+        soft.setDuty( 6, duty );
+        delay( 5 );
+        Timer2.readCapture( &period, &width );
+        while( !Timer2.readCapture( &period, &width ) )
+            ;
+        sprintf( _printBuff, "Duty %u/65536: width %lu of %lu ticks", duty,
+                 width, period );
+        Serial.println( _printBuff );
+    }
+    Timer2.endCapture();
+
+    soft.detach( 6 );
+    soft.end();
+}
+
+volatile uint32_t _toneDoneMs;
+
+void toneDone( uint8_t channel )
+{
+    _toneDoneMs = millis();
+}
+
+void testTone()
+{
+    static const ToneNote_t notes[] = {
+        {523, 150}, {0, 50}, {659, 150}, {0, 50}, {784, 300}};
+    uint32_t start, count;
+
+    // Two channels at once (TC2 on pin 5 and TC0 on pin 14), the first must
+    // still stop on time
+    _toneDoneMs = 0;
+    start = millis();
+    toneMillis( 0, 440, 250, toneDone );
+    toneMillis( 4, 880, 500 );
+    while( _toneDoneMs == 0 ) sleepCPU( _cpu );
+    sprintf( _printBuff, "Channel 0 took %lu ms, channel 4 %s",
+             _toneDoneMs - start,
+             isTonePlaying( 4 ) ? "still playing" : "stopped early" );
+    Serial.println( _printBuff );
+    while( isTonePlaying( 4 ) ) sleepCPU( _cpu );
+
+    // Channels 0 and 1 (TC2 and TC3) share a clock, ending channel 0 must
+    // leave channel 1 counting
+    _toneDoneMs = 0;
+    start = millis();
+    toneMillis( 0, 440, 250, toneDone );
+    toneMillis( 1, 660, 500 );
+    while( _toneDoneMs == 0 ) sleepCPU( _cpu );
+    count = Timer1.getCount();
+    delayMicroseconds( 100 );
+    sprintf( _printBuff, "Channel 0 took %lu ms, channel 1 %s and %s",
+             _toneDoneMs - start,
+             isTonePlaying( 1 ) ? "still playing" : "stopped early",
+             Timer1.getCount() != count ? "counting" : "FAILED, frozen" );
+    Serial.println( _printBuff );
+    while( isTonePlaying( 1 ) ) sleepCPU( _cpu );
+
+    // Channel 3's TC5 has no pin to play on
+    if( toneMillis( 3, 880, 500 ) )
+        Serial.println( "Tone on channel 3 FAILED to be refused" );
+
+    // 700 ms of notes with the CPU asleep
+    _toneDoneMs = 0;
+    start = millis();
+    playTones( 2, notes, sizeof( notes ) / sizeof( notes[0] ), toneDone );
+    while( _toneDoneMs == 0 ) sleepCPU( _cpu );
+    sprintf( _printBuff, "Sequence took %lu ms", _toneDoneMs - start );
+    Serial.println( _printBuff );
+
+    // Held until stopped
+    toneMillis( 1, 1000, 0 );
+    delay( 100 );
+    noTone( 1 );
+    if( !isTonePlaying( 1 ) ) Serial.println( "noTone() stopped channel 1" );
+}
+
+#define RTC_ALARM_COUNT 4
+
+RTCAlarm_t        _rtcAlarmsTest[RTC_ALARM_COUNT];
+RTCAlarm_t        _rtcTick;
+volatile uint64_t _rtcFired[RTC_ALARM_COUNT];
+volatile uint32_t _rtcTicks;
+
+// stepsRTC() from the interrupt is only safe as the loop is asleep
+void rtcAlarmCallback( RTCAlarm_t *alarm )
+{
+    _rtcFired[alarm - _rtcAlarmsTest] = stepsRTC();
+}
+
+void rtcTickCallback( RTCAlarm_t *alarm )
+{
+    if( ++_rtcTicks == 10 ) cancelRTCAlarm( alarm );
+}
+
+void testRTCAlarms()
+{
+    // Out of order, the last one a few overflows away
+    static const uint32_t delays[RTC_ALARM_COUNT] = {1638, 33, 327, 98304};
+    uint64_t              start;
+    uint8_t               armed;
+
+    start = stepsRTC();
+    _rtcTicks = 0;
+    for( uint8_t i = 0; i < RTC_ALARM_COUNT; i++ ) {
+        _rtcFired[i] = 0;
+        startRTCAlarm( &_rtcAlarmsTest[i], start + delays[i], rtcAlarmCallback,
+                       0 );
+    }
+    startRTCAlarm( &_rtcTick, start + 3277, rtcTickCallback, 3277 );
+
+    // Every wake-up is an alarm or an overflow
+    do {
+        sleepCPU( _deep_sleep );
+        armed = 0;
+        for( uint8_t i = 0; i < RTC_ALARM_COUNT; i++ )
+            armed += _rtcAlarmsTest[i].armed;
+    } while( armed != 0 || _rtcTick.armed );
+
+    for( uint8_t i = 0; i < RTC_ALARM_COUNT; i++ ) {
+        sprintf( _printBuff, "Alarm %u: due at %lu, fired at %lu steps", i,
+                 delays[i], (uint32_t)( _rtcFired[i] - start ) );
+        Serial.println( _printBuff );
+    }
+    sprintf( _printBuff, "%lu periodic ticks", _rtcTicks );
+    Serial.println( _printBuff );
+
+    // Cancelled before it could go off
+    startRTCAlarmIn( &_rtcAlarmsTest[0], 3277, rtcAlarmCallback, 0 );
+    if( cancelRTCAlarm( &_rtcAlarmsTest[0] ) &&
+        !cancelRTCAlarm( &_rtcAlarmsTest[0] ) )
+        Serial.println( "Alarm cancelled" );
+}
+
+// The I2C device the master test talks to, its register 0 holds the ID. The
+// slave test serves it from a second board.
+#define WIRE_TEST_ADDRESS 0x42
+#define WIRE_TEST_ID 0xA5
+#define WIRE_TEST_REGS 8
+
+volatile uint32_t     _wireDone;
+volatile WireStatus_t _wireStatus;
+
+void wireCallback( WireStatus_t status )
+{
+    _wireStatus = status;
+    _wireDone++;
+}
+
+// Counts loops until the callback to show the CPU is free in the meantime,
+// a bus that never finishes is left to waitForCompletion() to time out
+uint32_t waitWire( bool started )
+{
+    uint32_t loops = 0, start = millis();
+
+    if( !started ) {
+        _wireStatus = Wire.getStatus();
+        return 0;
+    }
+
+    while( !_wireDone && millis() - start < 100 ) loops++;
+    if( !_wireDone ) Wire.waitForCompletion();
+    _wireDone = 0;
+
+    return loops;
+}
+
+void testWireMaster()
+{
+    uint8_t  regs[WIRE_TEST_REGS], ptr = 0, data[2] = {0x12, 0x34};
+    uint8_t  wrap[4] = {0x66, 0x77, 0x00, 0xFF};
+    uint32_t loops;
+
+    Wire.begin();
+    Wire.setClock( 400000 );
+    _wireDone = 0;
+
+    // Register read, the pointer write and the read joined by a repeated
+    // start
+    regs[0] = 0;
+    loops = waitWire(
+        Wire.readRegisters( WIRE_TEST_ADDRESS, 0, regs, 1, wireCallback ) );
+    sprintf( _printBuff,
+             "readRegisters: status %d, ID %X (expected %X), %lu loops while "
+             "busy",
+             _wireStatus, regs[0], WIRE_TEST_ID, loops );
+    Serial.println( _printBuff );
+
+    loops = waitWire(
+        Wire.writeRegisters( WIRE_TEST_ADDRESS, 2, data, 2, wireCallback ) );
+    sprintf( _printBuff, "writeRegisters: status %d, %lu loops while busy",
+             _wireStatus, loops );
+    Serial.println( _printBuff );
+
+    // Across the end of the map, on to the read only ID and register 1 of
+    // which only the low nibble is writable
+    waitWire(
+        Wire.writeRegisters( WIRE_TEST_ADDRESS, 6, wrap, 4, wireCallback ) );
+    sprintf( _printBuff, "Wrapping writeRegisters: status %d", _wireStatus );
+    Serial.println( _printBuff );
+
+    // The whole map back in one transaction
+    memset( regs, 0, sizeof( regs ) );
+    waitWire( Wire.writeRead( WIRE_TEST_ADDRESS, &ptr, 1, regs,
+                              WIRE_TEST_REGS, wireCallback ) );
+    sprintf( _printBuff,
+             "writeRead: status %d, %02X %02X %02X %02X %02X %02X %02X %02X",
+             _wireStatus, regs[0], regs[1], regs[2], regs[3], regs[4], regs[5],
+             regs[6], regs[7] );
+    Serial.println( _printBuff );
+    Serial.println( regs[0] == WIRE_TEST_ID && regs[2] == 0x12 &&
+                            regs[3] == 0x34
+                        ? "Burst write read back"
+                        : "Burst write read back FAILED" );
+    Serial.println( regs[1] == 0x5F && regs[6] == 0x66 && regs[7] == 0x77
+                        ? "Wrapped write read back"
+                        : "Wrapped write read back FAILED" );
+
+    // Stream style, the pointer write keeps the bus for the read
+    Wire.beginTransmission( WIRE_TEST_ADDRESS );
+    Wire.write( 3 );
+    waitWire( Wire.endTransmissionAsync( false, wireCallback ) );
+    sprintf( _printBuff, "endTransmissionAsync: status %d", _wireStatus );
+    Serial.println( _printBuff );
+
+    waitWire( Wire.requestFromAsync( WIRE_TEST_ADDRESS, 1, true,
+                                     wireCallback ) );
+    sprintf( _printBuff,
+             "requestFromAsync: status %d, register 3 %X (expected 34)",
+             _wireStatus, Wire.read() );
+    Serial.println( _printBuff );
+
+    // Nobody home at the next address
+    waitWire( Wire.readRegisters( WIRE_TEST_ADDRESS + 1, 0, regs, 1,
+                                  wireCallback ) );
+    sprintf( _printBuff, "Empty address: status %d (expected %d)",
+             _wireStatus, wire_addr_nack );
+    Serial.println( _printBuff );
+
+    Wire.end();
+}
+
+// Register 0 is the read only ID and only the low nibble of register 1 can be
+// written
+volatile uint8_t  _wireRegs[WIRE_TEST_REGS];
+const uint8_t     _wireMask[WIRE_TEST_REGS] = {0x00, 0x0F, 0xFF, 0xFF,
+                                           0xFF, 0xFF, 0xFF, 0xFF};
+volatile uint8_t  _wireChangeFirst, _wireChangeCount;
+volatile uint32_t _wireChanges;
+
+void wireRegChange( uint8_t firstReg, uint8_t count )
+{
+    _wireChangeFirst = firstReg;
+    _wireChangeCount = count;
+    _wireChanges++;
+}
+
+void testWireSlave()
+{
+    uint32_t start, seen = 0;
+
+    memset( (void *)_wireRegs, 0, sizeof( _wireRegs ) );
+    _wireRegs[0] = WIRE_TEST_ID;
+    _wireRegs[1] = 0x50;
+    _wireChanges = 0;
+
+    Wire.begin( WIRE_TEST_ADDRESS );
+    Wire.setRegisterMap( _wireRegs, WIRE_TEST_REGS, _wireMask );
+    Wire.onRegisterChange( wireRegChange );
+
+    sprintf( _printBuff,
+             "Serving %u registers at %X for 30s, run the master test on the "
+             "other board",
+             WIRE_TEST_REGS, WIRE_TEST_ADDRESS );
+    Serial.println( _printBuff );
+
+    start = millis();
+    while( millis() - start < 30000 ) {
+        if( _wireChanges != seen ) {
+            seen = _wireChanges;
+            sprintf( _printBuff, "Registers %u to %u changed", _wireChangeFirst,
+                     _wireChangeFirst + _wireChangeCount - 1 );
+            Serial.println( _printBuff );
+        }
+    }
+    Wire.end();
+
+    sprintf( _printBuff, "Map: %02X %02X %02X %02X %02X %02X %02X %02X",
+             _wireRegs[0], _wireRegs[1], _wireRegs[2], _wireRegs[3],
+             _wireRegs[4], _wireRegs[5], _wireRegs[6], _wireRegs[7] );
+    Serial.println( _printBuff );
+
+    // The master's write from register 6 wrapped on to 0 and 1
+    Serial.println( _wireRegs[0] == WIRE_TEST_ID &&
+                            ( _wireRegs[1] & 0xF0 ) == 0x50
+                        ? "Write masks held"
+                        : "Write masks FAILED" );
+    Serial.println( _wireRegs[1] == 0x5F && _wireRegs[6] == 0x66 &&
+                            _wireRegs[7] == 0x77
+                        ? "Auto-increment wrapped"
+                        : "Auto-increment wrap FAILED" );
+}
+
+// Jumpered to SDA to hold it low like a stuck slave, and to SCL to count the
+// recovery clocks
+#define WIRE_TEST_HOLD_PIN 9
+#define WIRE_TEST_SCL_PIN 10
+
+volatile uint32_t _wireClocks, _wireReleaseAt;
+
+void wireClockISR()
+{
+    // Let go of SDA part way through, like a slave finishing its byte
+    if( ++_wireClocks == _wireReleaseAt ) pinMode( WIRE_TEST_HOLD_PIN, INPUT );
+}
+
+void testWireRecovery()
+{
+    const uint32_t rates[3] = {100000, 400000, 1000000};
+    const uint32_t lowMin[3] = {0, WIRE_FM_TLOW_NANOSECONDS,
+                                WIRE_FMPLUS_TLOW_NANOSECONDS};
+    uint8_t        baud, baudLow, status;
+    uint32_t       scl, lowNs;
+    uint8_t        regs[1];
+    bool           released;
+
+    // Timing at the current clock, never faster than asked and the fast modes
+    // keep SCL low for at least the specification minimum
+    for( uint8_t i = 0; i < 3; i++ ) {
+        scl = SERCOM::calculateBaudrateWIRE(
+            rates[i], WIRE_RISE_TIME_NANOSECONDS, &baud, &baudLow );
+        lowNs = (uint32_t)( (uint64_t)( baudLow + 5 ) * 1000000000ull /
+                            SystemCoreClock );
+        sprintf( _printBuff,
+                 "%lu Hz at %lu Hz: BAUD %u BAUDLOW %u, SCL %lu Hz, low %lu "
+                 "ns %s",
+                 rates[i], SystemCoreClock, baud, baudLow, scl, lowNs,
+                 scl <= rates[i] && ( baudLow == 0 || lowNs >= lowMin[i] )
+                     ? "OK"
+                     : "FAILED" );
+        Serial.println( _printBuff );
+    }
+
+    Wire.begin();
+    Wire.setWireTimeout( 1000, false );
+
+    // A stuck bus has to give up rather than hang
+    digitalWrite( WIRE_TEST_HOLD_PIN, LOW );
+    pinMode( WIRE_TEST_HOLD_PIN, OUTPUT );
+    Wire.beginTransmission( WIRE_TEST_ADDRESS );
+    Wire.write( 0 );
+    status = Wire.endTransmission();
+    sprintf( _printBuff, "SDA held: status %u, timeout flag %d", status,
+             Wire.getWireTimeoutFlag() );
+    Serial.println( _printBuff );
+    Wire.clearWireTimeoutFlag();
+
+    // Nothing lets go, all nine clocks and the STOP go out
+    _wireClocks = 0;
+    _wireReleaseAt = 0;
+    attachInterrupt( WIRE_TEST_SCL_PIN, wireClockISR, FALLING );
+    released = Wire.recoverBus();
+    sprintf( _printBuff,
+             "Recovery with SDA held: %s, %lu edges (expected stuck, 10)",
+             released ? "released" : "stuck", _wireClocks );
+    Serial.println( _printBuff );
+
+    // Released on the fifth clock, which ends the clocking early
+    _wireClocks = 0;
+    _wireReleaseAt = 5;
+    released = Wire.recoverBus();
+    sprintf( _printBuff, "Recovery: %s, %lu edges (expected released, 6)",
+             released ? "released" : "stuck", _wireClocks );
+    Serial.println( _printBuff );
+    detachInterrupt( WIRE_TEST_SCL_PIN );
+
+    // The SERCOM was started over, anything but a timeout means it works
+    Wire.setWireTimeout();
+    status = Wire.readRegisters( WIRE_TEST_ADDRESS, 0, regs, 1 )
+                 ? Wire.waitForCompletion()
+                 : Wire.getStatus();
+    sprintf( _printBuff, "After recovery: status %u", status );
+    Serial.println( _printBuff );
+
+    Wire.end();
+}
+
 void testWDTClear()
 {
     initWDT( wdt_8_s );